@@ -0,0 +1,141 @@
+/*
+ * Bands.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "Bands.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+SharedImage::SharedImage() {
+	data = NULL;
+	length = 0;
+}
+
+SharedImage::~SharedImage() {
+	release();
+}
+
+bool SharedImage::create(const std::string& path, const cv::Size& size) {
+	release();
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		return false;
+	}
+	size_t bytes = header_size + size_t(size.area()) * 3;
+	bool mapped = ftruncate(fd, bytes) == 0 && map(fd, bytes);
+	close(fd);
+	if (!mapped) {
+		return false;
+	}
+	Header* header = static_cast<Header*>(data);
+	header->cols = size.width;
+	header->rows = size.height;
+	image = cv::Mat(size, CV_8UC3, static_cast<uchar*>(data) + header_size);
+	return true;
+}
+
+bool SharedImage::open(const std::string& path) {
+	release();
+	int fd = ::open(path.c_str(), O_RDWR);
+	if (fd < 0) {
+		return false;
+	}
+	off_t bytes = lseek(fd, 0, SEEK_END);
+	bool mapped = bytes >= off_t(header_size) && map(fd, bytes);
+	close(fd);
+	if (!mapped) {
+		return false;
+	}
+	Header* header = static_cast<Header*>(data);
+	if (header->cols < 0 || header->rows < 0
+			|| header_size + size_t(header->cols) * header->rows * 3 > length) {
+		release();
+		return false;
+	}
+	image = cv::Mat(header->rows, header->cols, CV_8UC3,
+			static_cast<uchar*>(data) + header_size);
+	return true;
+}
+
+bool SharedImage::map(int fd, size_t bytes) {
+	void* addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		return false;
+	}
+	data = addr;
+	length = bytes;
+	return true;
+}
+
+void SharedImage::release() {
+	image.release();
+	if (data) {
+		munmap(data, length);
+	}
+	data = NULL;
+	length = 0;
+}
+
+cv::Mat& SharedImage::mat() {
+	return image;
+}
+
+std::vector<cv::Range> split_bands(int rows, int num_bands) {
+	num_bands = std::max(1, std::min(num_bands, rows));
+	std::vector<cv::Range> bands;
+	for (int i = 0; i < num_bands; i++) {
+		bands.push_back(
+				cv::Range(rows * i / num_bands, rows * (i + 1) / num_bands));
+	}
+	return bands;
+}
+
+int run_processes(const std::vector<std::vector<std::string> >& commands) {
+	// Arguments are built before forking, children only exec
+	std::vector<std::vector<char*> > argvs(commands.size());
+	for (size_t i = 0; i < commands.size(); i++) {
+		for (size_t j = 0; j < commands[i].size(); j++) {
+			argvs[i].push_back(const_cast<char*>(commands[i][j].c_str()));
+		}
+		argvs[i].push_back(NULL);
+	}
+	fflush(stdout);
+	std::vector<pid_t> children;
+	int failed = 0;
+	for (size_t i = 0; i < argvs.size(); i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			execv(argvs[i][0], &argvs[i][0]);
+			_exit(127);
+		}
+		if (pid < 0) {
+			failed++;
+		} else {
+			children.push_back(pid);
+		}
+	}
+	for (size_t i = 0; i < children.size(); i++) {
+		int status;
+		if (waitpid(children[i], &status, 0) != children[i]
+				|| !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			failed++;
+		}
+	}
+	return failed;
+}
+
+std::string self_executable() {
+	char path[4096];
+	ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if (len <= 0) {
+		return "";
+	}
+	path[len] = 0;
+	return path;
+}
@@ -0,0 +1,61 @@
+/*
+ * Bands.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_BANDS_H_
+#define SRC_BANDS_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+
+/*
+ * Distributed compositing: the output is split into bands of rows, each
+ * rendered from the session by a worker process into one shared image.
+ */
+
+/*
+ * CV_8UC3 image in a mmap-ed file, e.g. under /dev/shm, shared by processes.
+ * The file starts with a header of its size, pixels follow without padding.
+ * mat() stays valid until release or destruction.
+ */
+class SharedImage {
+public:
+	SharedImage();
+	virtual ~SharedImage();
+
+	//Create or truncate the file for an image of given size
+	bool create(const std::string&, const cv::Size&);
+	//Map an image created by another process
+	bool open(const std::string&);
+	void release();
+
+	cv::Mat& mat();
+
+private:
+	struct Header {
+		int cols, rows;
+	};
+	static const size_t header_size = 64;
+
+	bool map(int, size_t);
+
+	void* data;
+	size_t length;
+	cv::Mat image;
+};
+
+//Split rows into ranges of about the same height
+std::vector<cv::Range> split_bands(int, int);
+
+//Run commands as child processes at once and wait for all of them
+//Return number of commands failing
+int run_processes(const std::vector<std::vector<std::string> >&);
+
+//Path of the running executable, empty if unknown
+std::string self_executable();
+
+#endif /* SRC_BANDS_H_ */
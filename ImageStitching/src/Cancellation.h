@@ -0,0 +1,63 @@
+/*
+ * Cancellation.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_CANCELLATION_H_
+#define SRC_CANCELLATION_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+
+/*
+ * Cancellation of a running job, requested by another thread or a signal
+ * handler, or by a deadline passing. Only lock-free atomics are touched so
+ * cancel() is safe in a signal handler and expired() is cheap enough to be
+ * checked in every iteration of per-image loops.
+ */
+class CancelToken {
+public:
+	CancelToken() :
+			cancelled(false), deadline(0) {
+	}
+
+	void cancel() {
+		cancelled.store(true);
+	}
+
+	//Expire the token given seconds from now, <= 0 for no deadline
+	void set_deadline(double seconds) {
+		deadline.store(
+				seconds > 0 ?
+						cv::getTickCount()
+								+ (long long) (seconds * cv::getTickFrequency()) :
+						0);
+	}
+
+	//Clear cancellation and set the deadline of the next job
+	void restart(double seconds) {
+		cancelled.store(false);
+		set_deadline(seconds);
+	}
+
+	//Cancelled or past the deadline, expiring stays
+	bool expired() {
+		if (cancelled.load()) {
+			return true;
+		}
+		long long tick = deadline.load();
+		if (tick > 0 && cv::getTickCount() >= tick) {
+			cancelled.store(true);
+		}
+		return cancelled.load();
+	}
+
+private:
+	std::atomic<bool> cancelled;
+	std::atomic<long long> deadline; //tick count, 0 for none
+};
+
+#endif /* SRC_CANCELLATION_H_ */
@@ -0,0 +1,130 @@
+/*
+ * Canvas.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "Canvas.h"
+
+#include <opencv2/stitching/detail/util.hpp>
+
+#include "PixelKernels.h"
+
+float canvas_blend_width(const cv::Size& canvas) {
+	return sqrt(static_cast<float>(canvas.area())) * blend_strength / 100.f;
+}
+
+cv::Rect largest_rect(const cv::Mat& mask) {
+	cv::Rect best(0, 0, 0, 0);
+	//Height of the run of non-zero pixels ending at current row, with a sentinel
+	std::vector<int> height(mask.cols + 1, 0);
+	std::vector<int> stack;
+	for (int y = 0; y < mask.rows; y++) {
+		const uchar* row = mask.ptr<uchar>(y);
+		for (int x = 0; x < mask.cols; x++) {
+			height[x] = row[x] ? height[x] + 1 : 0;
+		}
+		stack.clear();
+		for (int x = 0; x <= mask.cols; x++) {
+			while (!stack.empty() && height[stack.back()] >= height[x]) {
+				int h = height[stack.back()];
+				stack.pop_back();
+				int left = stack.empty() ? 0 : stack.back() + 1;
+				if (h * (x - left) > best.area()) {
+					best = cv::Rect(left, y - h + 1, x - left, h);
+				}
+			}
+			stack.push_back(x);
+		}
+	}
+	return best;
+}
+
+cv::Rect valid_inner_rect(const std::vector<cv::Point>& corners,
+		const std::vector<cv::Mat>& masks) {
+	cv::Rect dst_roi = cv::detail::resultRoi(corners, masks);
+	cv::Mat coverage = cv::Mat::zeros(dst_roi.size(), CV_8U);
+	for (size_t i = 0; i < masks.size(); i++) {
+		cv::Mat part = coverage(
+				cv::Rect(corners[i] - dst_roi.tl(), masks[i].size()));
+		part |= masks[i];
+	}
+	//Drop border pixels, they are interpolated with the outside of images
+	cv::erode(coverage, coverage, cv::Mat());
+	cv::Rect inner = largest_rect(coverage);
+	return inner + dst_roi.tl();
+}
+
+cv::Rect scale_inner_rect(const cv::Rect& rect, double scale) {
+	int x0 = cvCeil(rect.x * scale), y0 = cvCeil(rect.y * scale);
+	int x1 = cvFloor(rect.br().x * scale), y1 = cvFloor(rect.br().y * scale);
+	return cv::Rect(x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0));
+}
+
+cv::Rect warp_region(const cv::Ptr<cv::detail::RotationWarper>& warper,
+		const cv::Mat& src, const cv::Mat& K, const cv::Mat& R,
+		const cv::Rect& region, cv::Mat& dst, cv::Mat& dst_mask) {
+	cv::Mat xmap, ymap;
+	// RotationWarper can only map its whole warpRoi
+	cv::Point tl = warper->buildMaps(src.size(), K, R, xmap, ymap).tl();
+	cv::Rect part = cv::Rect(tl, xmap.size()) & region;
+	if (part.area() <= 0) {
+		return cv::Rect(0, 0, 0, 0);
+	}
+	cv::Rect local = part - tl;
+	cv::remap(src, dst, xmap(local), ymap(local), cv::INTER_LINEAR,
+			cv::BORDER_REFLECT);
+	//Same as warping a full mask with nearest interpolation and constant border
+	map_mask(xmap(local), ymap(local), src.size(), dst_mask);
+	return part;
+}
+
+cv::detail::CameraParams decoded_camera(
+		const cv::detail::CameraParams& camera, int orientation,
+		const cv::Size& oriented_size, const cv::Size& decoded_size) {
+	//Raw pixel = M * oriented pixel + t, raw being decoded pixels at oriented_size
+	cv::Size raw_size = oriented_size;
+	double m[4] = { 1, 0, 0, 1 }, tx = 0, ty = 0;
+	switch (orientation) {
+	case 3:
+		m[0] = m[3] = -1;
+		tx = raw_size.width - 1;
+		ty = raw_size.height - 1;
+		break;
+	case 6:
+		std::swap(raw_size.width, raw_size.height);
+		m[0] = m[3] = 0;
+		m[1] = 1;
+		m[2] = -1;
+		ty = raw_size.height - 1;
+		break;
+	case 8:
+		std::swap(raw_size.width, raw_size.height);
+		m[0] = m[3] = 0;
+		m[1] = -1;
+		m[2] = 1;
+		tx = raw_size.width - 1;
+		break;
+	}
+	double fx = camera.focal, fy = camera.focal * camera.aspect;
+	if (m[0] == 0) {
+		std::swap(fx, fy);
+	}
+	double ppx = m[0] * camera.ppx + m[1] * camera.ppy + tx;
+	double ppy = m[2] * camera.ppx + m[3] * camera.ppy + ty;
+	//Pixel centres stay aligned when resampling to the decoded size
+	double sx = double(decoded_size.width) / raw_size.width;
+	double sy = double(decoded_size.height) / raw_size.height;
+	cv::detail::CameraParams decoded = camera;
+	decoded.focal = sx * fx;
+	decoded.aspect = sy * fy / decoded.focal;
+	decoded.ppx = sx * ppx + (sx - 1) / 2;
+	decoded.ppy = sy * ppy + (sy - 1) / 2;
+	double rotation[9] = { m[0], m[1], 0, m[2], m[3], 0, 0, 0, 1 };
+	cv::Mat M(3, 3, CV_64F, rotation), R;
+	camera.R.convertTo(R, CV_64F);
+	R = R * M.t();
+	R.convertTo(decoded.R, camera.R.type());
+	return decoded;
+}
@@ -0,0 +1,53 @@
+/*
+ * Canvas.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_CANVAS_H_
+#define SRC_CANVAS_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/stitching/detail/camera.hpp>
+#include <opencv2/stitching/detail/warpers.hpp>
+
+//Blend width in percent of the square root of the canvas area
+const float blend_strength = 5;
+
+//Width blended around seams of a canvas of this size
+float canvas_blend_width(const cv::Size&);
+
+//Largest rectangle of non-zero pixels of a mask
+cv::Rect largest_rect(const cv::Mat&);
+
+//Largest rectangle of the canvas covered by warped masks placed at their corners
+cv::Rect valid_inner_rect(const std::vector<cv::Point>&,
+		const std::vector<cv::Mat>&);
+
+//Scale a rectangle of the canvas, keeping only pixels fully inside it
+cv::Rect scale_inner_rect(const cv::Rect&, double);
+
+/*
+ * Warp only the part of an image falling into a region of the canvas
+ * Maps are still built for the whole image, only remapping is restricted;
+ * warp_projected builds them for the region alone
+ * dst, dst_mask: warped pixels and their valid mask
+ * Return the part of the canvas covered by dst, empty if image is outside region
+ */
+cv::Rect warp_region(const cv::Ptr<cv::detail::RotationWarper>&,
+		const cv::Mat&, const cv::Mat&, const cv::Mat&, const cv::Rect&,
+		cv::Mat&, cv::Mat&);
+
+/*
+ * Camera seeing the decoded pixels of an image as the given camera sees them
+ * after Exif orientation and resizing to oriented_size
+ * decoded_size: size of the pixels to warp, in their decoded orientation
+ */
+cv::detail::CameraParams decoded_camera(const cv::detail::CameraParams&, int,
+		const cv::Size&, const cv::Size&);
+
+#endif /* SRC_CANVAS_H_ */
@@ -0,0 +1,155 @@
+/*
+ * CanvasLoop.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "CanvasLoop.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "Canvas.h"
+
+//a mod m in [0, m)
+static int floor_mod(int a, int m) {
+	return ((a % m) + m) % m;
+}
+
+CanvasLoop::CanvasLoop() {
+	is_closed = false;
+}
+
+void CanvasLoop::set_cameras(
+		const std::vector<cv::detail::CameraParams>& cameras) {
+	headings.resize(cameras.size());
+	for (size_t i = 0; i < cameras.size(); i++) {
+		// Direction of the optical axis in the canvas frame is R * (0, 0, 1)
+		cv::Mat_<double> R;
+		cameras[i].R.convertTo(R, CV_64F);
+		headings[i] = atan2(R(0, 2), R(2, 2));
+	}
+	turns.assign(cameras.size(), 0);
+	is_closed = false;
+}
+
+void CanvasLoop::clear() {
+	headings.clear();
+	turns.clear();
+	is_closed = false;
+}
+
+bool CanvasLoop::empty() const {
+	return headings.empty();
+}
+
+int CanvasLoop::width(float scale) const {
+	return std::max(1, cvRound(2 * CV_PI * scale));
+}
+
+int CanvasLoop::shift(int i, float scale) const {
+	return cvRound(headings[i] * scale);
+}
+
+cv::Mat CanvasLoop::facing(int i, const cv::Mat& R, float scale) const {
+	// Turn by a whole number of columns, so facing rois only move by offset
+	double angle = -shift(i, scale) / double(scale);
+	float c = static_cast<float>(cos(angle));
+	float s = static_cast<float>(sin(angle));
+	float turn[9] = { c, 0, s, 0, 1, 0, -s, 0, c };
+	cv::Mat R32;
+	R.convertTo(R32, CV_32F);
+	cv::Mat turned = cv::Mat(3, 3, CV_32F, turn) * R32;
+	return turned;
+}
+
+int CanvasLoop::offset(int i, float scale) const {
+	return shift(i, scale) + turns[i] * width(scale);
+}
+
+bool CanvasLoop::close(const std::vector<cv::Rect>& rois, float scale) {
+	int columns = width(scale);
+	std::vector<uchar> covered(columns, 0);
+	std::vector<int> starts(rois.size());
+	for (size_t i = 0; i < rois.size(); i++) {
+		starts[i] = rois[i].x + shift(i, scale);
+		int span = std::min(rois[i].width, columns);
+		for (int c = 0; c < span; c++) {
+			covered[floor_mod(starts[i] + c, columns)] = 1;
+		}
+	}
+	int gap = std::find(covered.begin(), covered.end(), 0) - covered.begin();
+	is_closed = gap == columns;
+	// Unrolled just after an uncovered column, no image can cross it
+	int origin = is_closed ? 0 : gap + 1;
+	for (size_t i = 0; i < rois.size(); i++) {
+		int placed = origin + floor_mod(starts[i] - origin, columns);
+		turns[i] = (placed - starts[i]) / columns;
+	}
+	return is_closed;
+}
+
+bool CanvasLoop::closed() const {
+	return is_closed;
+}
+
+void wrap_copies(const std::vector<cv::Point>& corners,
+		const std::vector<cv::Mat>& masks, int width, std::vector<int>& source,
+		std::vector<cv::Point>& copies) {
+	source.clear();
+	copies.clear();
+	for (size_t i = 0; i < corners.size(); i++) {
+		if (corners[i].x + masks[i].cols > width) {
+			source.push_back(i);
+			copies.push_back(corners[i] - cv::Point(width, 0));
+		}
+		if (corners[i].x < 0) {
+			source.push_back(i);
+			copies.push_back(corners[i] + cv::Point(width, 0));
+		}
+	}
+}
+
+cv::Rect valid_loop_rect(const std::vector<cv::Point>& corners,
+		const std::vector<cv::Mat>& masks, int width) {
+	if (masks.empty()) {
+		return cv::Rect();
+	}
+	int top = corners[0].y, bottom = corners[0].y + masks[0].rows;
+	for (size_t i = 1; i < masks.size(); i++) {
+		top = std::min(top, corners[i].y);
+		bottom = std::max(bottom, corners[i].y + masks[i].rows);
+	}
+	cv::Mat coverage = cv::Mat::zeros(bottom - top, width, CV_8U);
+	for (size_t i = 0; i < masks.size(); i++) {
+		// Columns of a mask past the wrap land at the start of the loop
+		for (int x = 0; x < masks[i].cols;) {
+			int column = floor_mod(corners[i].x + x, width);
+			int span = std::min(masks[i].cols - x, width - column);
+			cv::Mat part = coverage(
+					cv::Rect(column, corners[i].y - top, span, masks[i].rows));
+			part |= masks[i](cv::Rect(x, 0, span, masks[i].rows));
+			x += span;
+		}
+	}
+	//Drop border pixels as valid_inner_rect does, the loop has no side border
+	cv::Mat wrapped;
+	cv::copyMakeBorder(coverage, wrapped, 0, 0, 1, 1, cv::BORDER_WRAP);
+	cv::erode(wrapped, wrapped, cv::Mat());
+	coverage = wrapped(cv::Rect(1, 0, width, coverage.rows));
+	int best_top = 0, best_rows = 0;
+	for (int y = 0, run = 0; y < coverage.rows; y++) {
+		run = cv::countNonZero(coverage.row(y)) == width ? run + 1 : 0;
+		if (run > best_rows) {
+			best_rows = run;
+			best_top = y - run + 1;
+		}
+	}
+	return cv::Rect(0, top + best_top, best_rows > 0 ? width : 0, best_rows);
+}
+
+int loop_margin(const cv::Size& canvas) {
+	// Four times the blend width of Stitcher::prepare_blender
+	int margin = cvCeil(4 * canvas_blend_width(canvas));
+	return std::min(canvas.width, margin);
+}
@@ -0,0 +1,71 @@
+/*
+ * CanvasLoop.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_CANVASLOOP_H_
+#define SRC_CANVASLOOP_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/stitching/detail/camera.hpp>
+
+/*
+ * Horizontal loop of a cylindrical or spherical canvas, where column
+ * scale * 2 pi is column 0 again. Every image is warped by its camera turned
+ * around the vertical axis to face column 0, so its pixels never straddle the
+ * wrap, then placed at the column of its heading. Images covering every column
+ * close the loop, the canvas is then a torus horizontally; otherwise the loop
+ * is unrolled at a gap and the canvas stays linear.
+ */
+class CanvasLoop {
+public:
+	CanvasLoop();
+
+	//Take headings of cameras, an empty loop places images as warped
+	void set_cameras(const std::vector<cv::detail::CameraParams>&);
+	void clear();
+	bool empty() const;
+
+	//Columns of a full turn at a warp scale
+	int width(float) const;
+	//Rotation of camera i turned to face column 0, at a warp scale
+	cv::Mat facing(int, const cv::Mat&, float) const;
+	//Column added to the roi of image i warped facing forward, at a warp scale
+	int offset(int, float) const;
+
+	/*
+	 * Place images from their rois warped facing forward at a warp scale:
+	 * close the loop if they cover every column, else unroll it at a gap
+	 * Return whether the loop is closed
+	 */
+	bool close(const std::vector<cv::Rect>&, float);
+	bool closed() const;
+
+private:
+	int shift(int, float) const;
+
+	std::vector<double> headings; //radian
+	std::vector<int> turns; //full turns added to place each image
+	bool is_closed;
+};
+
+/*
+ * Copies of warped masks crossing an edge of a closed loop of width columns, a turn
+ * to the other side, so seams and overlaps across the wrap are found linearly
+ * source: image of each copy
+ */
+void wrap_copies(const std::vector<cv::Point>&, const std::vector<cv::Mat>&,
+		int, std::vector<int>&, std::vector<cv::Point>&);
+
+//Rows of a closed loop of width columns covered at every column by masks at their corners
+cv::Rect valid_loop_rect(const std::vector<cv::Point>&,
+		const std::vector<cv::Mat>&, int);
+
+//Columns blended past each edge of a closed loop, so pyramids see the other side
+int loop_margin(const cv::Size&);
+
+#endif /* SRC_CANVASLOOP_H_ */
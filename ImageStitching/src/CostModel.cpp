@@ -0,0 +1,199 @@
+/*
+ * CostModel.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "CostModel.h"
+
+#include "FastFeatherBlender.h"
+
+/*
+ * Candidate settings from best quality to lowest latency
+ * Seam finder: 0 NO, 1 VORONOI, 5 DP_COLORGRAD
+ */
+static const CostModel::Settings presets[] = {
+		{ 0.6, 0.1, -1.0, 5, cv::detail::Blender::MULTI_BAND, 0 },
+		{ 0.3, 0.08, -1.0, 5, cv::detail::Blender::MULTI_BAND, 0 },
+		{ 0.3, 0.08, 8.0, 5, cv::detail::Blender::MULTI_BAND, 0 },
+		{ 0.3, 0.05, 4.0, 1, cv::detail::Blender::MULTI_BAND, 5 },
+		{ 0.2, 0.05, 2.0, 1, FastFeatherBlender::FAST_FEATHER, 0 },
+		{ 0.15, 0.03, 1.0, 0, FastFeatherBlender::FAST_FEATHER, 0 } };
+static const int num_presets = sizeof(presets) / sizeof(presets[0]);
+
+//First preset allowed and default budget (seconds, 0 is unlimited) of each tier
+static const int tier_first_preset[] = { 0, 1, 3 };
+static const double tier_budget[] = { 0, 60, 15 };
+
+CostModel::CostModel() {
+	density = 0.3;
+	//Rough values of a 4 cores machine, replaced by measurements
+	coef["features"] = 0.2;
+	coef["matching"] = 0.25;
+	coef["component"] = 1e-4;
+	coef["estimate"] = 1e-3;
+	coef["refine"] = 2e-3;
+	coef["warper"] = 1e-4;
+	coef["warp"] = 0.15;
+	coef["seam.0"] = 0.01;
+	coef["seam.1"] = 0.5;
+	coef["seam.2"] = 15.0;
+	coef["seam.3"] = 20.0;
+	coef["seam.4"] = 4.0;
+	coef["seam.5"] = 5.0;
+	coef["resize_mask"] = 1e-3;
+	coef["prepare_blend"] = 0.01;
+	coef["blend.0"] = 0.03;
+	coef["blend.1"] = 0.08;
+	coef["blend.2"] = 0.25;
+	coef["blend.3"] = 0.02;
+	coef["blend.4"] = 0.12;
+	coef["write"] = 0.04;
+}
+
+void CostModel::load(const std::string& file_name) {
+	std::ifstream ifs(file_name.c_str(), std::ifstream::in);
+	std::string name;
+	double value;
+	int count;
+	while (ifs >> name >> value >> count) {
+		if (name == "density") {
+			density = value;
+		} else {
+			coef[name] = value;
+		}
+		samples[name] = count;
+	}
+}
+
+void CostModel::save(const std::string& file_name) const {
+	std::ofstream ofs(file_name.c_str(), std::ofstream::out);
+	std::map<std::string, int>::const_iterator n = samples.find("density");
+	ofs << "density " << density << " "
+			<< (n == samples.end() ? 0 : n->second) << "\n";
+	for (std::map<std::string, double>::const_iterator i = coef.begin();
+			i != coef.end(); i++) {
+		n = samples.find(i->first);
+		ofs << i->first << " " << i->second << " "
+				<< (n == samples.end() ? 0 : n->second) << "\n";
+	}
+}
+
+CostModel::JobShape CostModel::shape(int num_images, double megapixels,
+		double candidate_pairs) const {
+	JobShape job;
+	job.num_images = num_images;
+	job.megapixels = megapixels;
+	job.candidate_pairs = candidate_pairs;
+	//A connected panorama has at least n-1 overlapping pairs
+	job.overlap_pairs = std::max(double(num_images - 1),
+			density * candidate_pairs);
+	return job;
+}
+
+std::string CostModel::key(PipelineStage stage,
+		const Settings& settings) const {
+	std::ostringstream ostr;
+	ostr << stage_name(stage);
+	switch (stage) {
+	case STAGE_SEAM:
+		ostr << "." << settings.seam_finder;
+		break;
+	case STAGE_BLEND:
+		ostr << "." << settings.blender;
+		break;
+	default:
+		break;
+	}
+	return ostr.str();
+}
+
+double CostModel::workload(PipelineStage stage, const JobShape& job,
+		const Settings& settings) const {
+	double n = job.num_images;
+	double reg_mp = job.megapixels, seam_mp = job.megapixels, comp_mp =
+			job.megapixels;
+	if (settings.registration_resol > 0)
+		reg_mp = std::min(reg_mp, settings.registration_resol);
+	seam_mp = std::min(seam_mp, settings.seam_estimation_resol);
+	if (settings.compositing_resol > 0)
+		comp_mp = std::min(comp_mp, settings.compositing_resol);
+	double overlap = std::max(0.0, job.overlap_pairs);
+	switch (stage) {
+	case STAGE_FEATURES:
+		return n * reg_mp;
+	case STAGE_MATCHING:
+		//Brute force matching, number of features grows with megapixels
+		return job.candidate_pairs * reg_mp * reg_mp;
+	case STAGE_ESTIMATE:
+		return overlap;
+	case STAGE_REFINE:
+		return overlap * n;
+	case STAGE_WARP:
+		return n * seam_mp;
+	case STAGE_SEAM:
+		return overlap * seam_mp;
+	case STAGE_PREPARE_BLEND:
+	case STAGE_BLEND:
+	case STAGE_WRITE:
+		return n * comp_mp;
+	default:
+		return n;
+	}
+}
+
+double CostModel::predict(PipelineStage stage, const JobShape& job,
+		const Settings& settings) const {
+	std::map<std::string, double>::const_iterator i = coef.find(
+			key(stage, settings));
+	if (i == coef.end())
+		return 0;
+	return i->second * workload(stage, job, settings);
+}
+
+double CostModel::predict(const JobShape& job, const Settings& settings) const {
+	double total = 0;
+	for (int i = 0; i < NUM_STAGES; i++) {
+		total += predict(PipelineStage(i), job, settings);
+	}
+	return total;
+}
+
+CostModel::Settings CostModel::choose(const JobShape& job, Tier tier,
+		double budget) const {
+	int first = tier_first_preset[tier];
+	if (budget <= 0)
+		budget = tier_budget[tier];
+	if (budget <= 0)
+		return presets[first];
+	for (int i = first; i < num_presets; i++) {
+		if (predict(job, presets[i]) <= budget)
+			return presets[i];
+	}
+	return presets[num_presets - 1];
+}
+
+void CostModel::update(const std::string& name, double& value,
+		double measured) {
+	//Plain mean for the first measurements, then moving average
+	int& count = samples[name];
+	double alpha = std::max(0.2, 1.0 / (count + 1));
+	value += alpha * (measured - value);
+	count++;
+}
+
+void CostModel::observe(const JobShape& job, const Settings& settings,
+		const std::vector<double>& stage_time) {
+	if (job.overlap_pairs >= 0 && job.candidate_pairs > 0) {
+		update("density", density, job.overlap_pairs / job.candidate_pairs);
+	}
+	for (int i = 0; i < NUM_STAGES && i < int(stage_time.size()); i++) {
+		PipelineStage stage = PipelineStage(i);
+		double work = workload(stage, job, settings);
+		if (stage_time[i] <= 0 || work <= 0)
+			continue;
+		std::string name = key(stage, settings);
+		update(name, coef[name], stage_time[i] / work);
+	}
+}
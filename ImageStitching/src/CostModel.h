@@ -0,0 +1,82 @@
+/*
+ * CostModel.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_COSTMODEL_H_
+#define SRC_COSTMODEL_H_
+
+#include <bits/stdc++.h>
+
+#include "PipelineStage.h"
+
+/*
+ * Predict time of every stage from the shape of a job and choose resolutions
+ * and algorithms fitting a time budget. Each stage costs coefficient * workload,
+ * coefficients are calibrated from measured stage times of finished passes.
+ */
+class CostModel {
+public:
+	enum Tier {
+		PREMIUM, STANDARD, FREE
+	};
+
+	/*
+	 * Shape of a job
+	 * megapixels: size of one input image
+	 * candidate_pairs: pairs going through pairwise matching
+	 * overlap_pairs: pairs that really overlap, predicted before matching
+	 */
+	struct JobShape {
+		int num_images;
+		double megapixels, candidate_pairs, overlap_pairs;
+	};
+
+	/*
+	 * Settings of one stitching pass
+	 * seam_finder: Stitcher's SeamFindType
+	 * blender: cv::detail::Blender's type, FastFeatherBlender::FAST_FEATHER or OverlapBlender::OVERLAP_MULTI_BAND
+	 * max_bands: upper bound of multi-band blender's bands, 0 for no bound
+	 */
+	struct Settings {
+		double registration_resol, seam_estimation_resol, compositing_resol;
+		int seam_finder, blender, max_bands;
+	};
+
+	CostModel();
+
+	//Load calibrated coefficients, keep defaults if file does not exist
+	void load(const std::string&);
+	//Save calibrated coefficients
+	void save(const std::string&) const;
+
+	//Job shape with overlap predicted from previous jobs
+	JobShape shape(int, double, double) const;
+
+	//Predicted time of one stage in seconds
+	double predict(PipelineStage, const JobShape&, const Settings&) const;
+	//Predicted time of the whole pass in seconds
+	double predict(const JobShape&, const Settings&) const;
+
+	//Best settings allowed by tier and fitting budget (seconds, <= 0 for tier's default)
+	Settings choose(const JobShape&, Tier, double) const;
+
+	//Calibrate with measured stage times of one pass
+	void observe(const JobShape&, const Settings&, const std::vector<double>&);
+
+private:
+	std::map<std::string, double> coef; //seconds per unit of workload
+	std::map<std::string, int> samples; //number of measurements of each coefficient
+	double density; //ratio of candidate pairs that overlap
+
+	//Coefficient's key, seam finding and blending depend on algorithm
+	std::string key(PipelineStage, const Settings&) const;
+	//Unit of work of a stage
+	double workload(PipelineStage, const JobShape&, const Settings&) const;
+	//Move estimate toward a new measurement
+	void update(const std::string&, double&, double);
+};
+
+#endif /* SRC_COSTMODEL_H_ */
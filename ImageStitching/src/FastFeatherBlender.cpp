@@ -0,0 +1,117 @@
+/*
+ * FastFeatherBlender.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "FastFeatherBlender.h"
+
+FastFeatherBlender::FastFeatherBlender(float sharpness) {
+	sharpness_ = sharpness;
+}
+
+float FastFeatherBlender::sharpness() const {
+	return sharpness_;
+}
+
+void FastFeatherBlender::setSharpness(float sharpness) {
+	sharpness_ = sharpness;
+}
+
+void FastFeatherBlender::prepare(cv::Rect dst_roi) {
+	dst_roi_ = dst_roi;
+	accumulated = cv::Mat::zeros(dst_roi.size(), CV_32SC3);
+	weight_sum = cv::Mat::zeros(dst_roi.size(), CV_32S);
+}
+
+void FastFeatherBlender::weight_map(const cv::Mat& mask,
+		std::vector<ushort>& weight) const {
+	int rows = mask.rows, cols = mask.cols;
+	// Weights stop growing at this distance
+	int cap = std::min(65534, cvCeil(1.f / std::max(sharpness_, 1e-5f)));
+	weight.resize(rows * cols);
+
+	// L1 distance to the nearest zero pixel, outside of the mask is far away.
+	// It is separable: distance inside columns first, then along rows.
+	for (int y = 0; y < rows; y++) {
+		const uchar* m = mask.ptr<uchar>(y);
+		ushort* d = &weight[y * cols];
+		const ushort* up = y > 0 ? &weight[(y - 1) * cols] : NULL;
+#pragma omp simd
+		for (int x = 0; x < cols; x++) {
+			int from_up = up ? up[x] + 1 : cap;
+			d[x] = m[x] ? std::min(from_up, cap) : 0;
+		}
+	}
+	for (int y = rows - 2; y >= 0; y--) {
+		ushort* d = &weight[y * cols];
+		const ushort* down = &weight[(y + 1) * cols];
+#pragma omp simd
+		for (int x = 0; x < cols; x++) {
+			d[x] = std::min(int(d[x]), down[x] + 1);
+		}
+	}
+	for (int y = 0; y < rows; y++) {
+		ushort* d = &weight[y * cols];
+		for (int x = 1; x < cols; x++) {
+			d[x] = std::min(int(d[x]), d[x - 1] + 1);
+		}
+		for (int x = cols - 2; x >= 0; x--) {
+			d[x] = std::min(int(d[x]), d[x + 1] + 1);
+		}
+	}
+
+	// Clipped sharpness * distance in Q8. Pixels of the mask keep at least
+	// weight 1, as FeatherBlender's WEIGHT_EPS, or wide blends would drop
+	// pixels near the mask border where only one image covers them
+	float scale = sharpness_ * weight_one;
+	ushort* w = &weight[0];
+#pragma omp simd
+	for (int i = 0; i < rows * cols; i++) {
+		int q = int(std::min(float(weight_one), w[i] * scale + 0.5f));
+		w[i] = ushort(w[i] ? std::max(q, 1) : 0);
+	}
+}
+
+void FastFeatherBlender::feed(const cv::Mat& img, const cv::Mat& mask,
+		cv::Point tl) {
+	CV_Assert(img.type() == CV_16SC3 && mask.type() == CV_8U);
+	std::vector<ushort> weight;
+	weight_map(mask, weight);
+	int dx = tl.x - dst_roi_.x, dy = tl.y - dst_roi_.y;
+	for (int y = 0; y < img.rows; y++) {
+		const short* src = img.ptr<short>(y);
+		const ushort* w = &weight[y * img.cols];
+		int* acc = accumulated.ptr<int>(dy + y) + dx * 3;
+		int* sum = weight_sum.ptr<int>(dy + y) + dx;
+#pragma omp simd
+		for (int x = 0; x < img.cols; x++) {
+			sum[x] += w[x];
+			acc[x * 3] += w[x] * src[x * 3];
+			acc[x * 3 + 1] += w[x] * src[x * 3 + 1];
+			acc[x * 3 + 2] += w[x] * src[x * 3 + 2];
+		}
+	}
+}
+
+void FastFeatherBlender::blend(cv::Mat& dst, cv::Mat& dst_mask) {
+	dst.create(accumulated.size(), CV_16SC3);
+	dst_mask.create(accumulated.size(), CV_8U);
+	for (int y = 0; y < dst.rows; y++) {
+		const int* acc = accumulated.ptr<int>(y);
+		const int* sum = weight_sum.ptr<int>(y);
+		short* d = dst.ptr<short>(y);
+		uchar* m = dst_mask.ptr<uchar>(y);
+#pragma omp simd
+		for (int x = 0; x < dst.cols; x++) {
+			float inv = sum[x] > 0 ? 1.f / sum[x] : 0.f;
+			d[x * 3] = short(cvRound(acc[x * 3] * inv));
+			d[x * 3 + 1] = short(cvRound(acc[x * 3 + 1] * inv));
+			d[x * 3 + 2] = short(cvRound(acc[x * 3 + 2] * inv));
+			m[x] = sum[x] > 0 ? 255 : 0;
+		}
+	}
+	accumulated.release();
+	weight_sum.release();
+}
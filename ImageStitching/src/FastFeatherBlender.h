@@ -0,0 +1,54 @@
+/*
+ * FastFeatherBlender.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_FASTFEATHERBLENDER_H_
+#define SRC_FASTFEATHERBLENDER_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/stitching/detail/blenders.hpp>
+
+/*
+ * Feather blender working in integers: weights are the L1 distance to the
+ * border of the mask times sharpness, clipped to 1 and kept in Q8 fixed point
+ * stored in 16 bits, never below 1 inside the mask;
+ * pixels are accumulated in 32-bit integers. Same weights as
+ * cv::detail::FeatherBlender up to rounding.
+ */
+class FastFeatherBlender: public cv::detail::Blender {
+public:
+	//Blend type of this blender, next to cv::detail::Blender's types
+	enum {
+		FAST_FEATHER = 3
+	};
+
+	FastFeatherBlender(float = 0.02f);
+
+	using cv::detail::Blender::prepare;
+
+	float sharpness() const;
+	void setSharpness(float);
+
+	void prepare(cv::Rect);
+	//img: CV_16SC3, mask: CV_8U
+	void feed(const cv::Mat&, const cv::Mat&, cv::Point);
+	//dst: CV_16SC3, dst_mask: CV_8U
+	void blend(cv::Mat&, cv::Mat&);
+
+private:
+	static const int weight_one = 1 << 8;
+
+	float sharpness_;
+	cv::Mat accumulated; //CV_32SC3, sum of weight * pixel
+	cv::Mat weight_sum; //CV_32S
+
+	//Q8 weights of a mask, row by row
+	void weight_map(const cv::Mat&, std::vector<ushort>&) const;
+};
+
+#endif /* SRC_FASTFEATHERBLENDER_H_ */
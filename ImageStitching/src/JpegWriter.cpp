@@ -0,0 +1,164 @@
+/*
+ * JpegWriter.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "JpegWriter.h"
+
+#include <csetjmp>
+#include <jpeglib.h>
+#include <omp.h>
+
+//Rows of an MCU with libjpeg's default 2x2 luminance sampling
+static const int mcu_rows = 16;
+
+//libjpeg error manager jumping back instead of exiting
+struct JpegError {
+	jpeg_error_mgr manager;
+	jmp_buf jump;
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+	longjmp(reinterpret_cast<JpegError*>(cinfo->err)->jump, 1);
+}
+
+//Encode rows of an image as a JPEG of their own, restarting every MCU row
+static bool encode_strip(const cv::Mat& image, const cv::Range& rows,
+		int quality, std::vector<uchar>& data) {
+	jpeg_compress_struct cinfo;
+	JpegError error;
+	cinfo.err = jpeg_std_error(&error.manager);
+	error.manager.error_exit = jpeg_error_exit;
+	unsigned char* buffer = NULL;
+	unsigned long size = 0;
+	std::vector<uchar> rgb;
+	if (setjmp(error.jump)) {
+		jpeg_destroy_compress(&cinfo);
+		free(buffer);
+		return false;
+	}
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &buffer, &size);
+	cinfo.image_width = image.cols;
+	cinfo.image_height = rows.size();
+	cinfo.input_components = 3;
+#ifdef JCS_EXTENSIONS
+	cinfo.in_color_space = JCS_EXT_BGR;
+#else
+	cinfo.in_color_space = JCS_RGB;
+	rgb.resize(image.cols * 3);
+#endif
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, quality, TRUE);
+	cinfo.restart_in_rows = 1;
+	jpeg_start_compress(&cinfo, TRUE);
+	for (int y = rows.start; y < rows.end; y++) {
+		JSAMPROW row = const_cast<uchar*>(image.ptr<uchar>(y));
+		if (!rgb.empty()) {
+			for (int x = 0; x < image.cols * 3; x += 3) {
+				rgb[x] = row[x + 2];
+				rgb[x + 1] = row[x + 1];
+				rgb[x + 2] = row[x];
+			}
+			row = &rgb[0];
+		}
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	data.assign(buffer, buffer + size);
+	free(buffer);
+	return true;
+}
+
+//End of the SOS segment, where entropy-coded data starts, 0 if not found
+//sof: position of the SOF0 marker
+static size_t scan_start(const std::vector<uchar>& data, size_t& sof) {
+	size_t pos = 2;
+	while (pos + 4 <= data.size() && data[pos] == 0xFF) {
+		uchar marker = data[pos + 1];
+		size_t length = (data[pos + 2] << 8) | data[pos + 3];
+		if (marker == 0xC0) {
+			sof = pos;
+		}
+		if (marker == 0xDA) {
+			return pos + 2 + length;
+		}
+		pos += 2 + length;
+	}
+	return 0;
+}
+
+bool write_jpeg(const std::string& file_name, const cv::Mat& image,
+		int quality) {
+	if (image.type() != CV_8UC3 || image.empty()
+			|| image.rows > JPEG_MAX_DIMENSION
+			|| image.cols > JPEG_MAX_DIMENSION) {
+		return false;
+	}
+	// Strips of whole MCU rows, a few per thread to even out their costs
+	int rows_of_mcus = (image.rows + mcu_rows - 1) / mcu_rows;
+	int num_strips = std::min(rows_of_mcus, 4 * omp_get_max_threads());
+	std::vector<std::vector<uchar> > strips(num_strips);
+	std::vector<int> first_mcu_row(num_strips);
+	std::vector<size_t> starts(num_strips);
+	std::vector<char> encoded(num_strips);
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < num_strips; i++) {
+		first_mcu_row[i] = rows_of_mcus * i / num_strips;
+		int end = rows_of_mcus * (i + 1) / num_strips;
+		cv::Range rows(first_mcu_row[i] * mcu_rows,
+				std::min(end * mcu_rows, image.rows));
+		size_t sof = 0;
+		encoded[i] = encode_strip(image, rows, quality, strips[i])
+				&& (starts[i] = scan_start(strips[i], sof)) > 0
+				&& strips[i].size() >= starts[i] + 2;
+		if (!encoded[i]) {
+			continue;
+		}
+		// Markers of the strip are numbered from 0, continue the image's
+		std::vector<uchar>& data = strips[i];
+		int restart = first_mcu_row[i];
+		for (size_t pos = starts[i]; pos + 3 < data.size(); pos++) {
+			if (data[pos] == 0xFF && data[pos + 1] >= 0xD0
+					&& data[pos + 1] <= 0xD7) {
+				data[pos + 1] = 0xD0 + restart % 8;
+				restart++;
+			}
+		}
+	}
+	if (std::find(encoded.begin(), encoded.end(), 0) != encoded.end()) {
+		return false;
+	}
+
+	// Headers of the 1st strip, with the height of the whole image
+	size_t sof = 0;
+	std::vector<uchar> header(strips[0].begin(),
+			strips[0].begin() + scan_start(strips[0], sof));
+	if (sof == 0) {
+		return false;
+	}
+	header[sof + 5] = image.rows >> 8;
+	header[sof + 6] = image.rows & 0xFF;
+	FILE* file = fopen(file_name.c_str(), "wb");
+	if (file == NULL) {
+		return false;
+	}
+	bool written = fwrite(&header[0], 1, header.size(), file) == header.size();
+	for (int i = 0; i < num_strips && written; i++) {
+		if (i > 0) {
+			uchar marker[] = { 0xFF, uchar(0xD0 + (first_mcu_row[i] - 1) % 8) };
+			written = fwrite(marker, 1, 2, file) == 2;
+		}
+		// Entropy-coded data without the strip's EOI
+		size_t length = strips[i].size() - 2 - starts[i];
+		written = written
+				&& fwrite(&strips[i][starts[i]], 1, length, file) == length;
+		std::vector<uchar>().swap(strips[i]);
+	}
+	uchar eoi[] = { 0xFF, 0xD9 };
+	written = written && fwrite(eoi, 1, 2, file) == 2;
+	return fclose(file) == 0 && written;
+}
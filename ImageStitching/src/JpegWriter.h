@@ -0,0 +1,25 @@
+/*
+ * JpegWriter.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_JPEGWRITER_H_
+#define SRC_JPEGWRITER_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+
+/*
+ * Write a CV_8UC3 image as one baseline JPEG encoded by strips in parallel.
+ * A restart marker ends every MCU row and Huffman tables are the standard
+ * ones, so each strip is coded exactly as in a single-threaded encoder and
+ * the strips are joined by renumbering their markers. The file is the same
+ * for any number of threads.
+ * Return false if the image can not be written this way
+ */
+bool write_jpeg(const std::string&, const cv::Mat&, int = 95);
+
+#endif /* SRC_JPEGWRITER_H_ */
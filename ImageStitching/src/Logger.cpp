@@ -0,0 +1,229 @@
+/*
+ * Logger.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "Logger.h"
+
+#include <cstdarg>
+
+std::atomic<int> log_level(LOG_LEVEL_INFO);
+
+//Bytes of a thread's ring, a message longer than half of it is cut
+static const size_t ring_size = 1 << 16;
+static const size_t max_message = ring_size / 2 - 12;
+
+/*
+ * Ring of one thread: the owner writes records of [sequence, length, bytes]
+ * at head, the flusher reads them at tail. Head and tail only grow.
+ */
+struct LogRing {
+	char data[ring_size];
+	std::atomic<uint64_t> head, tail;
+	std::atomic<uint64_t> dropped;
+	std::atomic<bool> orphaned; //owner thread ended
+	LogRing() :
+			head(0), tail(0), dropped(0), orphaned(false) {
+	}
+};
+
+//Marks the ring of a thread orphaned when the thread ends
+struct RingOwner {
+	LogRing* ring;
+	RingOwner() :
+			ring(NULL) {
+	}
+	~RingOwner() {
+		if (ring) {
+			ring->orphaned.store(true, std::memory_order_release);
+		}
+	}
+};
+
+static thread_local RingOwner ring_owner;
+
+struct LoggerState {
+	std::mutex mutex; //guards rings, flusher and out
+	std::vector<LogRing*> rings;
+	std::atomic<uint64_t> sequence;
+	std::atomic<bool> running;
+	bool stopping;
+	std::condition_variable wake;
+	std::thread flusher;
+	FILE* out;
+	LoggerState() :
+			sequence(0), running(false), stopping(false), out(NULL) {
+	}
+	~LoggerState() {
+		stop_logger();
+	}
+};
+
+static LoggerState logger;
+
+static void ring_copy_out(const LogRing& ring, uint64_t at, void* dst,
+		size_t size) {
+	size_t offset = at % ring_size, first = std::min(size, ring_size - offset);
+	memcpy(dst, ring.data + offset, first);
+	memcpy(static_cast<char*>(dst) + first, ring.data, size - first);
+}
+
+static void ring_copy_in(LogRing& ring, uint64_t at, const void* src,
+		size_t size) {
+	size_t offset = at % ring_size, first = std::min(size, ring_size - offset);
+	memcpy(ring.data + offset, src, first);
+	memcpy(ring.data, static_cast<const char*>(src) + first, size - first);
+}
+
+//Move every ring's records to the file, oldest first. Called with the mutex
+static void drain_rings() {
+	std::vector<std::pair<uint64_t, std::string> > records;
+	uint64_t dropped = 0;
+	for (size_t i = 0; i < logger.rings.size();) {
+		LogRing* ring = logger.rings[i];
+		// Orphaned is read first: an ended owner wrote nothing after it
+		bool orphaned = ring->orphaned.load(std::memory_order_acquire);
+		uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		while (tail < head) {
+			uint64_t sequence;
+			uint32_t length;
+			ring_copy_out(*ring, tail, &sequence, sizeof(sequence));
+			ring_copy_out(*ring, tail + sizeof(sequence), &length,
+					sizeof(length));
+			std::string text(length, '\0');
+			ring_copy_out(*ring, tail + sizeof(sequence) + sizeof(length),
+					&text[0], length);
+			records.push_back(std::make_pair(sequence, text));
+			tail += sizeof(sequence) + sizeof(length) + length;
+		}
+		ring->tail.store(tail, std::memory_order_release);
+		dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+		if (orphaned) {
+			delete ring;
+			logger.rings[i] = logger.rings.back();
+			logger.rings.pop_back();
+		} else {
+			i++;
+		}
+	}
+	if (records.empty() && dropped == 0) {
+		return;
+	}
+	std::sort(records.begin(), records.end());
+	for (size_t i = 0; i < records.size(); i++) {
+		fwrite(records[i].second.data(), 1, records[i].second.size(),
+				logger.out);
+	}
+	if (dropped) {
+		fprintf(logger.out, "Logger: %llu messages dropped\n",
+				(unsigned long long) dropped);
+	}
+	fflush(logger.out);
+}
+
+static void flush_loop() {
+	std::unique_lock<std::mutex> lock(logger.mutex);
+	while (!logger.stopping) {
+		logger.wake.wait_for(lock, std::chrono::milliseconds(50));
+		drain_rings();
+	}
+}
+
+bool start_logger(const std::string& path, int level) {
+	stop_logger();
+	set_log_level(level);
+	std::lock_guard<std::mutex> lock(logger.mutex);
+	logger.out = fopen(path.c_str(), "a");
+	bool opened = logger.out != NULL;
+	if (!opened) {
+		logger.out = stdout;
+	}
+	logger.stopping = false;
+	logger.flusher = std::thread(flush_loop);
+	logger.running.store(true, std::memory_order_release);
+	return opened;
+}
+
+void stop_logger() {
+	if (!logger.running.exchange(false)) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(logger.mutex);
+		logger.stopping = true;
+	}
+	logger.wake.notify_one();
+	logger.flusher.join();
+	std::lock_guard<std::mutex> lock(logger.mutex);
+	drain_rings();
+	if (logger.out != stdout) {
+		fclose(logger.out);
+	}
+	logger.out = NULL;
+}
+
+void set_log_level(int level) {
+	log_level.store(std::min(std::max(level, int(LOG_LEVEL_QUIET)),
+			int(LOG_LEVEL_DETAIL)), std::memory_order_relaxed);
+}
+
+int log_level_of(const std::string& name) {
+	if (name == "quiet") {
+		return LOG_LEVEL_QUIET;
+	} else if (name == "info") {
+		return LOG_LEVEL_INFO;
+	} else if (name == "detail") {
+		return LOG_LEVEL_DETAIL;
+	}
+	return -1;
+}
+
+void log_write(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	if (!logger.running.load(std::memory_order_acquire)) {
+		vprintf(format, args);
+		va_end(args);
+		return;
+	}
+	char buffer[1024];
+	int written = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	if (written < 0) {
+		return;
+	}
+	std::vector<char> longer;
+	const char* text = buffer;
+	size_t length = std::min(size_t(written), max_message);
+	if (size_t(written) >= sizeof(buffer)) {
+		longer.resize(length + 1);
+		va_start(args, format);
+		vsnprintf(&longer[0], longer.size(), format, args);
+		va_end(args);
+		text = &longer[0];
+	}
+
+	LogRing* ring = ring_owner.ring;
+	if (!ring) {
+		// The only lock of a thread, taken by its first message
+		ring = ring_owner.ring = new LogRing();
+		std::lock_guard<std::mutex> lock(logger.mutex);
+		logger.rings.push_back(ring);
+	}
+	uint64_t sequence = logger.sequence.fetch_add(1, std::memory_order_relaxed);
+	uint32_t size = length;
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	uint64_t tail = ring->tail.load(std::memory_order_acquire);
+	size_t record = sizeof(sequence) + sizeof(size) + length;
+	if (ring_size - (head - tail) < record) {
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	ring_copy_in(*ring, head, &sequence, sizeof(sequence));
+	ring_copy_in(*ring, head + sizeof(sequence), &size, sizeof(size));
+	ring_copy_in(*ring, head + sizeof(sequence) + sizeof(size), text, length);
+	ring->head.store(head + record, std::memory_order_release);
+}
@@ -0,0 +1,53 @@
+/*
+ * Logger.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_LOGGER_H_
+#define SRC_LOGGER_H_
+
+#include <bits/stdc++.h>
+
+/*
+ * Asynchronous log. A message is formatted by the thread logging it into
+ * that thread's own ring buffer, without locks or system calls; a background
+ * flusher drains all rings in the order messages were made and writes them
+ * to the log file. A full ring drops messages instead of blocking, the flusher
+ * reports how many. Messages above the level are not even formatted.
+ */
+
+enum LogLevel {
+	LOG_LEVEL_QUIET, LOG_LEVEL_INFO, LOG_LEVEL_DETAIL
+};
+
+//Messages of this level or lower are written
+extern std::atomic<int> log_level;
+
+inline bool log_enabled(int level) {
+	return level <= log_level.load(std::memory_order_relaxed);
+}
+
+//Start the flusher appending to a file, stdout if the file can not be opened
+bool start_logger(const std::string&, int = LOG_LEVEL_INFO);
+//Write queued messages and stop the flusher, later messages go to stdout
+void stop_logger();
+void set_log_level(int);
+//Level of a name: quiet, info or detail, -1 if unknown
+int log_level_of(const std::string&);
+
+//Printf into this thread's ring, or straight to stdout without a flusher
+void log_write(const char*, ...) __attribute__ ((format (printf, 1, 2)));
+
+#define LOG_INFO(...) do { \
+	if (log_enabled(LOG_LEVEL_INFO)) \
+		log_write(__VA_ARGS__); \
+} while (0)
+
+#define LOG_DETAIL(...) do { \
+	if (log_enabled(LOG_LEVEL_DETAIL)) \
+		log_write(__VA_ARGS__); \
+} while (0)
+
+#endif /* SRC_LOGGER_H_ */
@@ -0,0 +1,154 @@
+/*
+ * MatPool.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "MatPool.h"
+
+#include <sys/mman.h>
+
+static const size_t huge_page_size = 2 << 20;
+
+MatPool::MatPool() {
+	memset(&stats, 0, sizeof(stats));
+	huge_pages = false;
+	max_cached = size_t(1) << 30;
+}
+
+MatPool::~MatPool() {
+	release_cached();
+}
+
+void MatPool::set_huge_pages(bool enable) {
+	huge_pages = enable;
+}
+
+bool MatPool::get_huge_pages() {
+	return huge_pages;
+}
+
+void MatPool::set_max_cached(size_t bytes) {
+	max_cached = bytes;
+}
+
+cv::Mat& MatPool::attach(cv::Mat& mat) {
+	mat.allocator = this;
+	return mat;
+}
+
+void MatPool::release_cached() {
+	std::lock_guard<std::mutex> guard(lock);
+	for (std::map<size_t, std::vector<Header*> >::iterator i = cache.begin();
+			i != cache.end(); i++) {
+		for (size_t j = 0; j < i->second.size(); j++) {
+			destroy_block(i->second[j]);
+		}
+	}
+	cache.clear();
+	stats.bytes_cached = 0;
+}
+
+MatPool::Statistics MatPool::get_statistics() {
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+}
+
+size_t MatPool::size_class(size_t size) {
+	size_t step = 4096;
+	while (step * 8 <= size) {
+		step <<= 1;
+	}
+	return (size + step - 1) / step * step;
+}
+
+MatPool::Header* MatPool::create_block(size_t capacity) {
+	size_t length = capacity + header_size;
+	void* block = NULL;
+	bool mapped = false;
+	if (huge_pages && length >= huge_page_size) {
+		length = (length + huge_page_size - 1) / huge_page_size
+				* huge_page_size;
+		block = mmap(NULL, length, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (block == MAP_FAILED) {
+			block = NULL;
+		} else {
+			madvise(block, length, MADV_HUGEPAGE);
+			mapped = true;
+			capacity = length - header_size;
+		}
+	}
+	if (block == NULL && posix_memalign(&block, header_size, length) != 0) {
+		return NULL;
+	}
+	Header* header = static_cast<Header*>(block);
+	header->capacity = capacity;
+	header->mapped = mapped;
+	return header;
+}
+
+void MatPool::destroy_block(Header* header) {
+	if (header->mapped) {
+		munmap(header, header->capacity + header_size);
+	} else {
+		free(header);
+	}
+}
+
+void MatPool::allocate(int dims, const int* sizes, int type, int*& refcount,
+		uchar*& datastart, uchar*& data, size_t* step) {
+	size_t total = CV_ELEM_SIZE(type);
+	for (int i = dims - 1; i >= 0; i--) {
+		step[i] = total;
+		total *= sizes[i];
+	}
+	size_t capacity = size_class(total);
+
+	Header* header = NULL;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		std::map<size_t, std::vector<Header*> >::iterator i = cache.lower_bound(
+				capacity);
+		//Buffers of mmap-ed huge pages are rounded up, accept up to the next class
+		if (i != cache.end() && i->first <= size_class(capacity + 1)) {
+			header = i->second.back();
+			i->second.pop_back();
+			if (i->second.empty()) {
+				cache.erase(i);
+			}
+			stats.bytes_cached -= header->capacity;
+			stats.reuses++;
+		}
+	}
+	if (header == NULL) {
+		header = create_block(capacity);
+		if (header == NULL) {
+			CV_Error(CV_StsNoMem, "MatPool: failed to allocate buffer");
+		}
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	stats.allocations++;
+	stats.bytes_in_use += header->capacity;
+	stats.high_water = std::max(stats.high_water, stats.bytes_in_use);
+	header->refcount = 1;
+	refcount = &header->refcount;
+	datastart = data = reinterpret_cast<uchar*>(header) + header_size;
+}
+
+void MatPool::deallocate(int* refcount, uchar* datastart, uchar* data) {
+	if (datastart == NULL) {
+		return;
+	}
+	Header* header = reinterpret_cast<Header*>(datastart - header_size);
+	std::lock_guard<std::mutex> guard(lock);
+	stats.bytes_in_use -= header->capacity;
+	if (stats.bytes_cached + header->capacity > max_cached) {
+		destroy_block(header);
+		return;
+	}
+	cache[header->capacity].push_back(header);
+	stats.bytes_cached += header->capacity;
+}
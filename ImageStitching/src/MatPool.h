@@ -0,0 +1,70 @@
+/*
+ * MatPool.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_MATPOOL_H_
+#define SRC_MATPOOL_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+
+/*
+ * Allocator for large short-lived Mats. Released buffers are kept in size
+ * classes and handed out again instead of going back to the system, which
+ * avoids page faults of fresh mmap-ed memory on every warp and blend.
+ * A Mat uses the pool when attached before its data is created.
+ */
+class MatPool: public cv::MatAllocator {
+public:
+	struct Statistics {
+		size_t allocations; //buffers handed out
+		size_t reuses; //buffers handed out from cache
+		size_t bytes_in_use, high_water; //bytes held by Mats, and its peak
+		size_t bytes_cached; //bytes kept for reuse
+	};
+
+	MatPool();
+	virtual ~MatPool();
+
+	//Back buffers of at least 2MB by transparent huge pages
+	void set_huge_pages(bool);
+	bool get_huge_pages();
+	//Upper bound of cached bytes, larger releases go back to the system
+	void set_max_cached(size_t);
+
+	//Make the Mat allocate from this pool, call before its data is created
+	cv::Mat& attach(cv::Mat&);
+	//Return cached buffers to the system
+	void release_cached();
+
+	Statistics get_statistics();
+
+	void allocate(int, const int*, int, int*&, uchar*&, uchar*&, size_t*);
+	void deallocate(int*, uchar*, uchar*);
+
+private:
+	//Placed in front of every buffer
+	struct Header {
+		size_t capacity; //usable bytes after header
+		int refcount;
+		bool mapped; //allocated by mmap
+	};
+	static const size_t header_size = 64;
+
+	std::mutex lock;
+	std::map<size_t, std::vector<Header*> > cache; //capacity to free buffers
+	Statistics stats;
+	bool huge_pages;
+	size_t max_cached;
+
+	//Round size up to its size class, 4 classes per power of two
+	static size_t size_class(size_t);
+	Header* create_block(size_t);
+	void destroy_block(Header*);
+};
+
+#endif /* SRC_MATPOOL_H_ */
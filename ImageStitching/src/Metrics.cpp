@@ -0,0 +1,116 @@
+/*
+ * Metrics.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "Metrics.h"
+
+void Metrics::load(const std::string& file_name) {
+	std::ifstream ifs(file_name.c_str(), std::ifstream::in);
+	std::string line;
+	while (std::getline(ifs, line)) {
+		if (line.empty()) {
+			continue;
+		}
+		if (line[0] == '#') {
+			std::istringstream istr(line);
+			std::string hash, keyword, family, type;
+			istr >> hash >> keyword >> family >> type;
+			if (keyword == "TYPE") {
+				declare(family, type);
+			}
+			continue;
+		}
+		size_t space = line.find_last_of(' ');
+		if (space == std::string::npos) {
+			continue;
+		}
+		at(line.substr(0, space)) = atof(line.c_str() + space + 1);
+	}
+}
+
+bool Metrics::save(const std::string& file_name) const {
+	std::string tmp_name = file_name + ".tmp";
+	std::ofstream ofs(tmp_name.c_str(), std::ofstream::out);
+	if (!ofs) {
+		return false;
+	}
+	ofs.precision(10);
+	for (size_t t = 0; t < types.size(); t++) {
+		const std::string& family = types[t].first;
+		ofs << "# TYPE " << family << " " << types[t].second << "\n";
+		for (size_t i = 0; i < series.size(); i++) {
+			const std::string& name = series[i].first;
+			std::string base = name.substr(0, name.find('{'));
+			if (base == family || base == family + "_bucket"
+					|| base == family + "_sum" || base == family + "_count") {
+				ofs << name << " " << series[i].second << "\n";
+			}
+		}
+	}
+	ofs.close();
+	return rename(tmp_name.c_str(), file_name.c_str()) == 0;
+}
+
+void Metrics::inc(const std::string& name, const std::string& labels,
+		double value) {
+	declare(name, "counter");
+	at(series_name(name, labels)) += value;
+}
+
+void Metrics::set(const std::string& name, const std::string& labels,
+		double value) {
+	declare(name, "gauge");
+	at(series_name(name, labels)) = value;
+}
+
+void Metrics::observe(const std::string& name, const std::string& labels,
+		double value, const Buckets& buckets) {
+	declare(name, "histogram");
+	for (size_t i = 0; i < buckets.size(); i++) {
+		std::ostringstream le;
+		le << "le=\"" << buckets[i] << "\"";
+		double& bucket = at(series_name(name + "_bucket", labels, le.str()));
+		if (value <= buckets[i]) {
+			bucket += 1;
+		}
+	}
+	at(series_name(name + "_bucket", labels, "le=\"+Inf\"")) += 1;
+	at(series_name(name + "_sum", labels)) += value;
+	at(series_name(name + "_count", labels)) += 1;
+}
+
+double& Metrics::at(const std::string& name) {
+	std::map<std::string, size_t>::iterator i = index.find(name);
+	if (i == index.end()) {
+		index[name] = series.size();
+		series.push_back(std::make_pair(name, 0.0));
+		return series.back().second;
+	}
+	return series[i->second].second;
+}
+
+void Metrics::declare(const std::string& family, const std::string& type) {
+	for (size_t i = 0; i < types.size(); i++) {
+		if (types[i].first == family) {
+			return;
+		}
+	}
+	types.push_back(std::make_pair(family, type));
+}
+
+std::string Metrics::series_name(const std::string& name,
+		const std::string& labels, const std::string& extra) {
+	if (labels.empty() && extra.empty()) {
+		return name;
+	}
+	if (labels.empty()) {
+		return name + "{" + extra + "}";
+	}
+	if (extra.empty()) {
+		return name + "{" + labels + "}";
+	}
+	return name + "{" + labels + "," + extra + "}";
+}
@@ -0,0 +1,48 @@
+/*
+ * Metrics.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_METRICS_H_
+#define SRC_METRICS_H_
+
+#include <bits/stdc++.h>
+
+/*
+ * Counters, gauges and histograms aggregated over jobs, saved in Prometheus
+ * text format (for node exporter's textfile collector). Values are read back
+ * from the saved file so counters keep growing across runs.
+ */
+class Metrics {
+public:
+	//Histogram buckets' upper bounds, +Inf is added automatically
+	typedef std::vector<double> Buckets;
+
+	//Read series from a file written by save()
+	void load(const std::string&);
+	//Write all series, file is replaced atomically
+	bool save(const std::string&) const;
+
+	/*
+	 * Record a value
+	 * name: metric name, labels: Prometheus labels without braces, e.g. stage="seam"
+	 */
+	void inc(const std::string&, const std::string& = "", double = 1);
+	void set(const std::string&, const std::string&, double);
+	void observe(const std::string&, const std::string&, double,
+			const Buckets&);
+
+private:
+	std::vector<std::pair<std::string, double> > series; //in order of first record
+	std::map<std::string, size_t> index; //series' name to position
+	std::vector<std::pair<std::string, std::string> > types; //metric family and type
+
+	double& at(const std::string&);
+	void declare(const std::string&, const std::string&);
+	static std::string series_name(const std::string&, const std::string&,
+			const std::string& = "");
+};
+
+#endif /* SRC_METRICS_H_ */
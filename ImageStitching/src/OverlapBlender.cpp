@@ -0,0 +1,132 @@
+/*
+ * OverlapBlender.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "OverlapBlender.h"
+
+OverlapBlender::OverlapBlender(int bands) {
+	num_bands = bands;
+	zoned = false;
+}
+
+int OverlapBlender::numBands() const {
+	return num_bands;
+}
+
+void OverlapBlender::setNumBands(int bands) {
+	num_bands = bands;
+}
+
+int OverlapBlender::margin() const {
+	// Same reach as the border MultiBandBlender keeps around fed images
+	return 3 << std::max(num_bands, 0);
+}
+
+void OverlapBlender::prepare(cv::Rect dst_roi) {
+	cv::detail::Blender::prepare(dst_roi);
+	zones.clear();
+	blend_rois.clear();
+	blenders.clear();
+	zoned = false;
+	zone_mask = cv::Mat::zeros(dst_roi.size(), CV_8U);
+}
+
+static cv::Rect grow(const cv::Rect& rect, int margin) {
+	return cv::Rect(rect.x - margin, rect.y - margin, rect.width + 2 * margin,
+			rect.height + 2 * margin);
+}
+
+void OverlapBlender::set_overlaps(const std::vector<cv::Rect>& overlaps) {
+	zoned = true;
+	zones.clear();
+	for (size_t i = 0; i < overlaps.size(); i++) {
+		cv::Rect zone = grow(overlaps[i], margin()) & dst_roi_;
+		if (zone.area() > 0) {
+			zones.push_back(zone);
+		}
+	}
+	// Merge intersecting zones so every pixel has one pyramid
+	for (bool merged = true; merged;) {
+		merged = false;
+		for (size_t i = 0; i < zones.size() && !merged; i++) {
+			for (size_t j = i + 1; j < zones.size() && !merged; j++) {
+				if ((zones[i] & zones[j]).area() > 0) {
+					zones[i] |= zones[j];
+					zones.erase(zones.begin() + j);
+					merged = true;
+				}
+			}
+		}
+	}
+	blend_rois.clear();
+	blenders.clear();
+	zone_mask.setTo(cv::Scalar::all(0));
+	for (size_t i = 0; i < zones.size(); i++) {
+		blend_rois.push_back(grow(zones[i], margin()) & dst_roi_);
+		cv::detail::MultiBandBlender* blender =
+				new cv::detail::MultiBandBlender(false, num_bands);
+		blender->prepare(blend_rois[i]);
+		blenders.push_back(blender);
+		zone_mask(zones[i] - dst_roi_.tl()).setTo(cv::Scalar::all(255));
+	}
+}
+
+void OverlapBlender::feed(const cv::Mat& img, const cv::Mat& mask,
+		cv::Point tl) {
+	CV_Assert(img.type() == CV_16SC3 && mask.type() == CV_8U);
+	if (!zoned) {
+		set_overlaps(std::vector<cv::Rect>(1, dst_roi_));
+	}
+	cv::Rect rect(tl, img.size());
+	// Pixels of one image only are copied
+	cv::Mat copy_mask;
+	cv::bitwise_and(mask, ~zone_mask(rect - dst_roi_.tl()), copy_mask);
+	cv::detail::Blender::feed(img, copy_mask, tl);
+
+	for (size_t i = 0; i < blenders.size(); i++) {
+		cv::Rect part = rect & blend_rois[i];
+		if (part.area() > 0) {
+			blenders[i]->feed(img(part - tl), mask(part - tl), part.tl());
+		}
+	}
+}
+
+void OverlapBlender::blend(cv::Mat& dst, cv::Mat& dst_mask) {
+	for (size_t i = 0; i < blenders.size(); i++) {
+		cv::Mat pyramid, pyramid_mask;
+		blenders[i]->blend(pyramid, pyramid_mask);
+		cv::Rect zone = zones[i] - blend_rois[i].tl();
+		cv::Rect dst_zone = zones[i] - dst_roi_.tl();
+		pyramid(zone).copyTo(dst_(dst_zone));
+		pyramid_mask(zone).copyTo(dst_mask_(dst_zone));
+	}
+	blenders.clear();
+	zone_mask.release();
+	cv::detail::Blender::blend(dst, dst_mask);
+}
+
+std::vector<cv::Rect> overlap_rects(const std::vector<cv::Point>& corners,
+		const std::vector<cv::Mat>& masks) {
+	std::vector<cv::Size> sizes;
+	for (size_t i = 0; i < masks.size(); i++) {
+		sizes.push_back(masks[i].size());
+	}
+	cv::Rect canvas = cv::detail::resultRoi(corners, sizes);
+	cv::Mat coverage = cv::Mat::zeros(canvas.size(), CV_8U);
+	for (size_t i = 0; i < masks.size(); i++) {
+		cv::Mat covered = coverage(cv::Rect(corners[i] - canvas.tl(), sizes[i]));
+		cv::add(covered, cv::Scalar::all(1), covered, masks[i]);
+	}
+	cv::Mat overlap = coverage >= 2;
+	std::vector<std::vector<cv::Point> > contours;
+	cv::findContours(overlap, contours, CV_RETR_EXTERNAL,
+			CV_CHAIN_APPROX_SIMPLE);
+	std::vector<cv::Rect> rects;
+	for (size_t i = 0; i < contours.size(); i++) {
+		rects.push_back(cv::boundingRect(contours[i]) + canvas.tl());
+	}
+	return rects;
+}
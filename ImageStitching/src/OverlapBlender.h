@@ -0,0 +1,61 @@
+/*
+ * OverlapBlender.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_OVERLAPBLENDER_H_
+#define SRC_OVERLAPBLENDER_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/stitching/detail/blenders.hpp>
+
+/*
+ * Multi-band blender working only around overlaps of images. Each zone, an
+ * overlap grown by the reach of the pyramid, is blended by its own
+ * cv::detail::MultiBandBlender on the zone grown once more, so the edges of
+ * its pyramid stay outside the zone. Pixels outside zones are covered by one
+ * image and copied. Without zones the whole output is one zone.
+ */
+class OverlapBlender: public cv::detail::Blender {
+public:
+	//Blend type of this blender, next to cv::detail::Blender's types
+	enum {
+		OVERLAP_MULTI_BAND = 4
+	};
+
+	OverlapBlender(int = 5);
+
+	using cv::detail::Blender::prepare;
+
+	int numBands() const;
+	void setNumBands(int);
+	//Pixels around an overlap reached by the pyramid
+	int margin() const;
+
+	void prepare(cv::Rect);
+	//Overlaps in output coordinates, call after prepare and before feeding
+	void set_overlaps(const std::vector<cv::Rect>&);
+	//img: CV_16SC3, mask: CV_8U
+	void feed(const cv::Mat&, const cv::Mat&, cv::Point);
+	//dst: CV_16SC3, dst_mask: CV_8U
+	void blend(cv::Mat&, cv::Mat&);
+
+private:
+	int num_bands;
+	bool zoned; //overlaps are set
+	std::vector<cv::Rect> zones; //pixels taken from pyramids, disjoint
+	std::vector<cv::Rect> blend_rois; //regions of pyramids
+	std::vector<cv::Ptr<cv::detail::Blender> > blenders;
+	cv::Mat zone_mask; //CV_8U, non-zero inside zones
+};
+
+//Bounding rectangles of regions covered by 2 or more masks placed at their corners
+std::vector<cv::Rect> overlap_rects(const std::vector<cv::Point>&,
+		const std::vector<cv::Mat>&);
+
+#endif /* SRC_OVERLAPBLENDER_H_ */
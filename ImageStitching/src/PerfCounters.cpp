@@ -0,0 +1,120 @@
+/*
+ * PerfCounters.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "PerfCounters.h"
+
+#include <linux/perf_event.h>
+#include <omp.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const uint32_t event_types[PerfCounters::NUM_EVENTS] = {
+		PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+		PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE };
+static const uint64_t event_configs[PerfCounters::NUM_EVENTS] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_SW_PAGE_FAULTS,
+		PERF_COUNT_SW_CONTEXT_SWITCHES };
+
+//Counter of an event on the calling thread, -1 if refused
+//inherit: also count threads and processes it creates later
+static int open_event(int event, bool inherit) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = event_types[event];
+	attr.config = event_configs[event];
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+			| PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.exclude_hv = 1;
+	attr.inherit = inherit;
+	// Kernel time is counted only where perf_event_paranoid allows it
+	for (int exclude_kernel = 0; exclude_kernel < 2; exclude_kernel++) {
+		attr.exclude_kernel = exclude_kernel;
+		int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if (fd >= 0) {
+			return fd;
+		}
+	}
+	return -1;
+}
+
+PerfCounters::PerfCounters() {
+}
+
+PerfCounters::~PerfCounters() {
+	close();
+}
+
+bool PerfCounters::open() {
+	close();
+	fds.assign(omp_get_max_threads(), std::vector<int>(NUM_EVENTS, -1));
+	// Each thread of the pool opens counters of itself. The calling thread's
+	// counters are inherited by threads and processes started after the pool,
+	// e.g. component parts and band workers
+#pragma omp parallel num_threads(fds.size())
+	{
+		int thread = omp_get_thread_num();
+		std::vector<int>& thread_fds = fds[thread];
+		for (int event = 0; event < NUM_EVENTS; event++) {
+			thread_fds[event] = open_event(event, thread == 0);
+		}
+	}
+	if (!is_open()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void PerfCounters::close() {
+	for (size_t i = 0; i < fds.size(); i++) {
+		for (size_t j = 0; j < fds[i].size(); j++) {
+			if (fds[i][j] >= 0) {
+				::close(fds[i][j]);
+			}
+		}
+	}
+	fds.clear();
+}
+
+bool PerfCounters::is_open() const {
+	for (size_t i = 0; i < fds.size(); i++) {
+		for (size_t j = 0; j < fds[i].size(); j++) {
+			if (fds[i][j] >= 0) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+PerfCounters::Values PerfCounters::read() const {
+	Values values(NUM_EVENTS, -1);
+	for (size_t i = 0; i < fds.size(); i++) {
+		for (int event = 0; event < NUM_EVENTS; event++) {
+			uint64_t data[3]; // value, time enabled, time running
+			if (fds[i][event] < 0
+					|| ::read(fds[i][event], data, sizeof(data))
+							!= sizeof(data)) {
+				continue;
+			}
+			double value = double(data[0]);
+			if (data[2] > 0 && data[2] < data[1]) {
+				value *= double(data[1]) / data[2];
+			}
+			values[event] = std::max(values[event], 0.0) + value;
+		}
+	}
+	return values;
+}
+
+const char* PerfCounters::event_name(Event event) {
+	static const char* names[NUM_EVENTS] = { "cycles", "instructions",
+			"llc_misses", "page_faults", "context_switches" };
+	return names[event];
+}
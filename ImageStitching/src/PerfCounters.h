@@ -0,0 +1,49 @@
+/*
+ * PerfCounters.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_PERFCOUNTERS_H_
+#define SRC_PERFCOUNTERS_H_
+
+#include <bits/stdc++.h>
+
+/*
+ * Hardware and software counters of the process's OpenMP threads, read
+ * through perf_event_open. Counters are opened on each thread of the OpenMP
+ * pool and summed when read, scaled up when the kernel multiplexed them.
+ * Threads and processes started later by the opening thread, e.g. component
+ * parts and band workers, are counted through inheritance, but only once they
+ * exit; threads started before, e.g. the log flusher, are not counted.
+ * Events the kernel refuses (perf_event_paranoid, virtual machines without
+ * PMU) read as -1, the rest still work.
+ */
+class PerfCounters {
+public:
+	enum Event {
+		CYCLES, INSTRUCTIONS, LLC_MISSES, PAGE_FAULTS, CONTEXT_SWITCHES, NUM_EVENTS
+	};
+	typedef std::vector<double> Values; //one per event, -1 if not counted
+
+	PerfCounters();
+	virtual ~PerfCounters();
+
+	//Open counters on every thread of the OpenMP pool
+	//Return false if no event can be counted
+	bool open();
+	void close();
+	bool is_open() const;
+
+	//Counts since open, summed over threads
+	Values read() const;
+
+	//Short name of an event, used in logs
+	static const char* event_name(Event);
+
+private:
+	std::vector<std::vector<int> > fds; //per thread, per event, -1 if not opened
+};
+
+#endif /* SRC_PERFCOUNTERS_H_ */
@@ -0,0 +1,36 @@
+/*
+ * PipelineStage.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_PIPELINESTAGE_H_
+#define SRC_PIPELINESTAGE_H_
+
+//Stages of one stitching pass, in execution order
+enum PipelineStage {
+	STAGE_FEATURES,
+	STAGE_MATCHING,
+	STAGE_COMPONENT,
+	STAGE_ESTIMATE,
+	STAGE_REFINE,
+	STAGE_WARPER,
+	STAGE_WARP,
+	STAGE_SEAM,
+	STAGE_RESIZE_MASK,
+	STAGE_PREPARE_BLEND,
+	STAGE_BLEND,
+	STAGE_WRITE,
+	NUM_STAGES
+};
+
+//Short name of a stage, used as key in logs and saved files
+inline const char* stage_name(PipelineStage stage) {
+	static const char* names[NUM_STAGES] = { "features", "matching",
+			"component", "estimate", "refine", "warper", "warp", "seam",
+			"resize_mask", "prepare_blend", "blend", "write" };
+	return names[stage];
+}
+
+#endif /* SRC_PIPELINESTAGE_H_ */
@@ -0,0 +1,271 @@
+/*
+ * PixelKernels.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "PixelKernels.h"
+
+/*
+ * Bodies of the kernels, inlined into one function per instruction set. The
+ * compiler vectorizes each copy for its target; the reference copy is not
+ * vectorized at all.
+ */
+#define KERNEL_BODY static inline __attribute__((always_inline))
+
+KERNEL_BODY void map_mask_body(const float* x, const float* y, uchar* mask,
+		int n, int cols, int rows) {
+	// round(v) in [0, size - 1] is v in [-0.5, size - 0.5)
+	const float max_x = cols - 0.5f, max_y = rows - 0.5f;
+	for (int i = 0; i < n; i++) {
+		bool inside = x[i] >= -0.5f && y[i] >= -0.5f && x[i] < max_x
+				&& y[i] < max_y;
+		mask[i] = inside ? 255 : 0;
+	}
+}
+
+KERNEL_BODY void and_mask_body(const uchar* a, const uchar* b, uchar* dst,
+		int n) {
+	for (int i = 0; i < n; i++) {
+		dst[i] = a[i] & b[i];
+	}
+}
+
+KERNEL_BODY void widen_body(const uchar* src, short* dst, int n) {
+	for (int i = 0; i < n; i++) {
+		dst[i] = src[i];
+	}
+}
+
+KERNEL_BODY void blend_rows_body(const uchar* top, const uchar* bottom,
+		int weight, int* dst, int n) {
+	const int top_weight = (1 << kernel_weight_bits) - weight;
+	for (int i = 0; i < n; i++) {
+		dst[i] = top[i] * top_weight + bottom[i] * weight;
+	}
+}
+
+KERNEL_BODY void sample_row_body(const int* row, const int* x0, const int* x1,
+		const int* weight, uchar* dst, int n) {
+	const int shift = 2 * kernel_weight_bits, one = 1 << kernel_weight_bits;
+	for (int i = 0; i < n; i++) {
+		int value = row[x0[i]] * (one - weight[i]) + row[x1[i]] * weight[i];
+		dst[i] = static_cast<uchar>((value + (1 << (shift - 1))) >> shift);
+	}
+}
+
+#define DEFINE_KERNELS(suffix, attribute, feature) \
+	attribute static void map_mask_##suffix(const float* x, const float* y, \
+			uchar* mask, int n, int cols, int rows) { \
+		map_mask_body(x, y, mask, n, cols, rows); \
+	} \
+	attribute static void and_mask_##suffix(const uchar* a, const uchar* b, \
+			uchar* dst, int n) { \
+		and_mask_body(a, b, dst, n); \
+	} \
+	attribute static void widen_##suffix(const uchar* src, short* dst, int n) { \
+		widen_body(src, dst, n); \
+	} \
+	attribute static void blend_rows_##suffix(const uchar* top, \
+			const uchar* bottom, int weight, int* dst, int n) { \
+		blend_rows_body(top, bottom, weight, dst, n); \
+	} \
+	attribute static void sample_row_##suffix(const int* row, const int* x0, \
+			const int* x1, const int* weight, uchar* dst, int n) { \
+		sample_row_body(row, x0, x1, weight, dst, n); \
+	} \
+	static const PixelKernels kernels_##suffix = { #suffix, feature, \
+			map_mask_##suffix, and_mask_##suffix, widen_##suffix, \
+			blend_rows_##suffix, sample_row_##suffix };
+
+DEFINE_KERNELS(scalar, __attribute__((optimize("no-tree-vectorize"))), "")
+DEFINE_KERNELS(sse2, , "")
+DEFINE_KERNELS(sse42, __attribute__((target("sse4.2"))), "sse4.2")
+DEFINE_KERNELS(avx2, __attribute__((target("avx2"))), "avx2")
+DEFINE_KERNELS(avx512, __attribute__((target("avx512f,avx512bw"))), "avx512bw")
+
+//Vectorized variants, narrowest first
+static const PixelKernels* const variants[] = { &kernels_sse2, &kernels_sse42,
+		&kernels_avx2, &kernels_avx512 };
+
+static bool cpu_supports(const char* feature) {
+	__builtin_cpu_init();
+	std::string name = feature;
+	if (name.empty()) {
+		return true;
+	} else if (name == "sse4.2") {
+		return __builtin_cpu_supports("sse4.2");
+	} else if (name == "avx2") {
+		return __builtin_cpu_supports("avx2");
+	} else if (name == "avx512bw") {
+		return __builtin_cpu_supports("avx512f")
+				&& __builtin_cpu_supports("avx512bw");
+	}
+	return false;
+}
+
+std::vector<const PixelKernels*> supported_kernels() {
+	std::vector<const PixelKernels*> kernels(1, &kernels_scalar);
+	for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+		if (cpu_supports(variants[i]->feature)) {
+			kernels.push_back(variants[i]);
+		}
+	}
+	return kernels;
+}
+
+const PixelKernels& pixel_kernels() {
+	static const PixelKernels* best = supported_kernels().back();
+	return *best;
+}
+
+int self_test_kernels() {
+	std::mt19937 random(2026);
+	std::uniform_int_distribution<int> byte(0, 255), weight(0,
+			1 << kernel_weight_bits);
+	std::uniform_real_distribution<float> coordinate(-3.f, 70.f);
+	// Odd length so every variant also runs its tail loop
+	const int n = 1031, cols = 64, rows = 48;
+	std::vector<float> x(n), y(n);
+	std::vector<uchar> a(n), b(n);
+	std::vector<int> x0(n), x1(n), weights(n);
+	for (int i = 0; i < n; i++) {
+		// Exact halves sit on the edges of the mask
+		x[i] = i % 17 == 0 ? cols - 0.5f : coordinate(random);
+		y[i] = i % 19 == 0 ? -0.5f : coordinate(random) * rows / cols;
+		a[i] = byte(random);
+		b[i] = byte(random);
+		x0[i] = random() % n;
+		x1[i] = std::min(x0[i] + 3, n - 1);
+		weights[i] = weight(random);
+	}
+	int top_weight = weight(random);
+
+	std::vector<const PixelKernels*> kernels = supported_kernels();
+	std::vector<uchar> mask(n), masked(n), sampled(n);
+	std::vector<short> wide(n);
+	std::vector<int> blended(n);
+	const PixelKernels& reference = *kernels[0];
+	reference.map_mask(&x[0], &y[0], &mask[0], n, cols, rows);
+	reference.and_mask(&a[0], &b[0], &masked[0], n);
+	reference.widen(&a[0], &wide[0], n);
+	reference.blend_rows(&a[0], &b[0], top_weight, &blended[0], n);
+	reference.sample_row(&blended[0], &x0[0], &x1[0], &weights[0], &sampled[0],
+			n);
+
+	int failed = 0;
+	for (size_t k = 1; k < kernels.size(); k++) {
+		const PixelKernels& variant = *kernels[k];
+		std::vector<uchar> mask_v(n), masked_v(n), sampled_v(n);
+		std::vector<short> wide_v(n);
+		std::vector<int> blended_v(n);
+		variant.map_mask(&x[0], &y[0], &mask_v[0], n, cols, rows);
+		variant.and_mask(&a[0], &b[0], &masked_v[0], n);
+		variant.widen(&a[0], &wide_v[0], n);
+		variant.blend_rows(&a[0], &b[0], top_weight, &blended_v[0], n);
+		variant.sample_row(&blended[0], &x0[0], &x1[0], &weights[0],
+				&sampled_v[0], n);
+		std::string mismatches;
+		if (mask_v != mask) {
+			mismatches += " map_mask";
+		}
+		if (masked_v != masked) {
+			mismatches += " and_mask";
+		}
+		if (wide_v != wide) {
+			mismatches += " widen";
+		}
+		if (blended_v != blended) {
+			mismatches += " blend_rows";
+		}
+		if (sampled_v != sampled) {
+			mismatches += " sample_row";
+		}
+		printf("%s: %s%s\n", variant.name, mismatches.empty() ? "ok" : "FAILED",
+				mismatches.c_str());
+		failed += !mismatches.empty();
+	}
+	printf("Selected kernels: %s\n", pixel_kernels().name);
+	return failed;
+}
+
+void map_mask(const cv::Mat& xmap, const cv::Mat& ymap, const cv::Size& size,
+		cv::Mat& mask) {
+	const PixelKernels& kernels = pixel_kernels();
+	mask.create(xmap.size(), CV_8U);
+	for (int y = 0; y < xmap.rows; y++) {
+		kernels.map_mask(xmap.ptr<float>(y), ymap.ptr<float>(y),
+				mask.ptr<uchar>(y), xmap.cols, size.width, size.height);
+	}
+}
+
+void widen_to_16s(const cv::Mat& src, cv::Mat& dst) {
+	CV_Assert(src.depth() == CV_8U);
+	const PixelKernels& kernels = pixel_kernels();
+	dst.create(src.size(), CV_MAKETYPE(CV_16S, src.channels()));
+	int n = src.cols * src.channels();
+	for (int y = 0; y < src.rows; y++) {
+		kernels.widen(src.ptr<uchar>(y), dst.ptr<short>(y), n);
+	}
+}
+
+void and_masks(const cv::Mat& a, const cv::Mat& b, cv::Mat& dst) {
+	CV_Assert(a.type() == CV_8U && b.type() == CV_8U && a.size() == b.size());
+	const PixelKernels& kernels = pixel_kernels();
+	dst.create(a.size(), CV_8U);
+	for (int y = 0; y < a.rows; y++) {
+		kernels.and_mask(a.ptr<uchar>(y), b.ptr<uchar>(y), dst.ptr<uchar>(y),
+				a.cols);
+	}
+}
+
+//Source index and weight of a destination coordinate, as cv::INTER_LINEAR
+static int linear_source(int d, double scale, int size, int& weight) {
+	double f = (d + 0.5) * scale - 0.5;
+	int s = cvFloor(f);
+	f -= s;
+	if (s < 0) {
+		s = 0;
+		f = 0;
+	}
+	if (s >= size - 1) {
+		s = size - 1;
+		f = 0;
+	}
+	weight = cvRound(f * (1 << kernel_weight_bits));
+	return s;
+}
+
+void resize_bilinear(const cv::Mat& src, cv::Mat& dst, const cv::Size& size) {
+	CV_Assert(src.type() == CV_8UC3);
+	dst.create(size, CV_8UC3);
+	const int cn = 3, n = size.width * cn;
+	double scale_x = double(src.cols) / size.width;
+	double scale_y = double(src.rows) / size.height;
+	std::vector<int> x0(n), x1(n), weights(n);
+	for (int x = 0; x < size.width; x++) {
+		int weight;
+		int s = linear_source(x, scale_x, src.cols, weight);
+		for (int c = 0; c < cn; c++) {
+			x0[x * cn + c] = s * cn + c;
+			x1[x * cn + c] = std::min(s + 1, src.cols - 1) * cn + c;
+			weights[x * cn + c] = weight;
+		}
+	}
+	const PixelKernels& kernels = pixel_kernels();
+#pragma omp parallel
+	{
+		std::vector<int> row(src.cols * cn);
+#pragma omp for
+		for (int y = 0; y < size.height; y++) {
+			int weight;
+			int s = linear_source(y, scale_y, src.rows, weight);
+			kernels.blend_rows(src.ptr<uchar>(s),
+					src.ptr<uchar>(std::min(s + 1, src.rows - 1)), weight,
+					&row[0], src.cols * cn);
+			kernels.sample_row(&row[0], &x0[0], &x1[0], &weights[0],
+					dst.ptr<uchar>(y), n);
+		}
+	}
+}
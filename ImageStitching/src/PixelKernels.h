@@ -0,0 +1,64 @@
+/*
+ * PixelKernels.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_PIXELKERNELS_H_
+#define SRC_PIXELKERNELS_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+
+/*
+ * Row loops of warping, blending and preview, compiled once per instruction
+ * set (baseline SSE2, SSE4.2, AVX2, AVX-512) and picked at run time, so one
+ * binary uses the widest vectors of any machine of the fleet. Every variant
+ * computes in integers or exact comparisons, so all of them give the same
+ * bytes as the scalar reference.
+ */
+struct PixelKernels {
+	const char* name;
+	//Instruction set the variant needs, empty for baseline
+	const char* feature;
+	//mask[i] = 255 if (x[i], y[i]) rounds to a pixel of a cols x rows image
+	void (*map_mask)(const float*, const float*, uchar*, int, int, int);
+	//dst[i] = a[i] & b[i]
+	void (*and_mask)(const uchar*, const uchar*, uchar*, int);
+	//CV_8U to CV_16S
+	void (*widen)(const uchar*, short*, int);
+	//dst[i] = top[i] * (2048 - weight) + bottom[i] * weight
+	void (*blend_rows)(const uchar*, const uchar*, int, int*, int);
+	//dst[i] = (row[x0[i]] * (2048 - weight[i]) + row[x1[i]] * weight[i]) >> 22, rounded
+	void (*sample_row)(const int*, const int*, const int*, const int*, uchar*,
+			int);
+};
+
+//Bits of weights of blend_rows and sample_row
+const int kernel_weight_bits = 11;
+
+//Variant of the widest instruction set this CPU supports, chosen once
+const PixelKernels& pixel_kernels();
+
+//Scalar reference, then every variant this CPU supports
+std::vector<const PixelKernels*> supported_kernels();
+
+//Compare every supported variant with the scalar reference on random rows,
+//printing one line per variant. Return number of variants not matching
+int self_test_kernels();
+
+//Valid mask of maps of a warp: 255 where the map rounds inside an image of size
+void map_mask(const cv::Mat&, const cv::Mat&, const cv::Size&, cv::Mat&);
+
+//CV_8UC3 to CV_16SC3
+void widen_to_16s(const cv::Mat&, cv::Mat&);
+
+//dst = a & b for CV_8U masks of the same size, dst may be a or b
+void and_masks(const cv::Mat&, const cv::Mat&, cv::Mat&);
+
+//Bilinear resize of a CV_8UC3 image in fixed point, for previews
+void resize_bilinear(const cv::Mat&, cv::Mat&, const cv::Size&);
+
+#endif /* SRC_PIXELKERNELS_H_ */
@@ -0,0 +1,91 @@
+/*
+ * Predictor.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "Predictor.h"
+
+std::vector<int> biggest_component(
+		const std::vector<cv::detail::MatchesInfo>& pairs, int num_images,
+		double confidence) {
+	std::vector<int> parent(num_images);
+	for (int i = 0; i < num_images; i++) {
+		parent[i] = i;
+	}
+	for (size_t k = 0; k < pairs.size(); k++) {
+		if (pairs[k].confidence <= confidence || pairs[k].src_img_idx < 0
+				|| pairs[k].dst_img_idx < 0) {
+			continue;
+		}
+		int a = pairs[k].src_img_idx, b = pairs[k].dst_img_idx;
+		while (parent[a] != a) {
+			a = parent[a];
+		}
+		while (parent[b] != b) {
+			b = parent[b];
+		}
+		parent[b] = a;
+	}
+	std::vector<int> root(num_images), size(num_images, 0);
+	int biggest = 0;
+	for (int i = 0; i < num_images; i++) {
+		root[i] = i;
+		while (parent[root[i]] != root[i]) {
+			root[i] = parent[root[i]];
+		}
+		if (++size[root[i]] > size[biggest]) {
+			biggest = root[i];
+		}
+	}
+	std::vector<int> indices;
+	for (int i = 0; i < num_images; i++) {
+		if (root[i] == biggest) {
+			indices.push_back(i);
+		}
+	}
+	return indices;
+}
+
+OverlapPrediction predict_overlap(const std::vector<cv::Mat>& thumbnails,
+		const cv::Mat& matching_mask, double confidence_threshold) {
+	OverlapPrediction prediction;
+	prediction.num_images = thumbnails.size();
+	prediction.readable = prediction.strong = prediction.weak = 0;
+	std::vector<cv::Mat> images;
+	for (size_t i = 0; i < thumbnails.size(); i++) {
+		if (!thumbnails[i].empty()) {
+			images.push_back(thumbnails[i]);
+		}
+	}
+	prediction.readable = images.size();
+	if (images.size() < 2) {
+		return prediction;
+	}
+	int n = images.size();
+	int num_features = std::min(1000, images[0].size().area() / 100);
+	cv::Ptr<cv::detail::FeaturesFinder> finder =
+			new cv::detail::OrbFeaturesFinder(cv::Size(1, 1), num_features,
+					1.3f, 3);
+	std::vector<cv::detail::ImageFeatures> features(n);
+#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		(*finder)(images[i], features[i]);
+		features[i].img_idx = i;
+	}
+	finder->collectGarbage();
+
+	std::vector<cv::detail::MatchesInfo> pairs;
+	cv::detail::BestOf2NearestMatcher matcher;
+	if (matching_mask.rows == n && matching_mask.cols == n) {
+		matcher(features, pairs, matching_mask);
+	} else {
+		matcher(features, pairs);
+	}
+	matcher.collectGarbage();
+	prediction.strong = biggest_component(pairs, n, confidence_threshold).size();
+	prediction.weak = biggest_component(pairs, n,
+			weak_ratio * confidence_threshold).size();
+	return prediction;
+}
@@ -0,0 +1,40 @@
+/*
+ * Predictor.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_PREDICTOR_H_
+#define SRC_PREDICTOR_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/stitching/detail/matchers.hpp>
+
+/*
+ * Overlap of input images predicted from thumbnails before registration
+ * readable: thumbnails that are not empty
+ * strong: images of the biggest component of pairs above confidence threshold
+ * weak: images of the biggest component of pairs above weak_ratio of it
+ */
+struct OverlapPrediction {
+	int num_images, readable, strong, weak;
+};
+
+//Fraction of confidence threshold making a weak pair
+const double weak_ratio = 0.3;
+//Megapixels of thumbnails made from full images
+const double thumbnail_resol = 0.1;
+
+//Images of the biggest component of pairs above a confidence, in increasing order
+std::vector<int> biggest_component(const std::vector<cv::detail::MatchesInfo>&,
+		int, double);
+
+//Match thumbnails (pairs of a non-empty matching mask only) and measure their components
+OverlapPrediction predict_overlap(const std::vector<cv::Mat>&, const cv::Mat&,
+		double);
+
+#endif /* SRC_PREDICTOR_H_ */
@@ -0,0 +1,233 @@
+/*
+ * Prescreen.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "Prescreen.h"
+
+#include <csetjmp>
+#include <jpeglib.h>
+
+//libjpeg error manager jumping back instead of exiting
+struct JpegError {
+	jpeg_error_mgr manager;
+	jmp_buf jump;
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+	longjmp(reinterpret_cast<JpegError*>(cinfo->err)->jump, 1);
+}
+
+static bool is_jpeg(const std::string& file_name) {
+	std::string extension = file_name.substr(file_name.find_last_of('.') + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(),
+			::tolower);
+	return extension == "jpg" || extension == "jpeg" || extension == "jpe";
+}
+
+static cv::Mat decode_jpeg(const std::string& file_name, int denominator) {
+	FILE* file = fopen(file_name.c_str(), "rb");
+	if (file == NULL) {
+		return cv::Mat();
+	}
+	jpeg_decompress_struct cinfo;
+	JpegError error;
+	cinfo.err = jpeg_std_error(&error.manager);
+	error.manager.error_exit = jpeg_error_exit;
+	cv::Mat image;
+	if (setjmp(error.jump)) {
+		jpeg_destroy_decompress(&cinfo);
+		fclose(file);
+		return cv::Mat();
+	}
+	jpeg_create_decompress(&cinfo);
+	jpeg_stdio_src(&cinfo, file);
+	jpeg_read_header(&cinfo, TRUE);
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = denominator;
+	cinfo.out_color_space = cinfo.num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+	cinfo.dct_method = JDCT_IFAST;
+	jpeg_start_decompress(&cinfo);
+	image.create(cinfo.output_height, cinfo.output_width,
+			CV_MAKETYPE(CV_8U, cinfo.output_components));
+	while (cinfo.output_scanline < cinfo.output_height) {
+		JSAMPROW row = image.ptr<uchar>(cinfo.output_scanline);
+		jpeg_read_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	fclose(file);
+	cv::cvtColor(image, image,
+			image.channels() == 1 ? CV_GRAY2BGR : CV_RGB2BGR);
+	return image;
+}
+
+cv::Size read_image_size(const std::string& file_name) {
+	if (is_jpeg(file_name)) {
+		FILE* file = fopen(file_name.c_str(), "rb");
+		if (file != NULL) {
+			jpeg_decompress_struct cinfo;
+			JpegError error;
+			cinfo.err = jpeg_std_error(&error.manager);
+			error.manager.error_exit = jpeg_error_exit;
+			if (setjmp(error.jump)) {
+				jpeg_destroy_decompress(&cinfo);
+				fclose(file);
+				return cv::imread(file_name).size();
+			}
+			jpeg_create_decompress(&cinfo);
+			jpeg_stdio_src(&cinfo, file);
+			jpeg_read_header(&cinfo, TRUE);
+			cv::Size size(cinfo.image_width, cinfo.image_height);
+			jpeg_destroy_decompress(&cinfo);
+			fclose(file);
+			return size;
+		}
+	}
+	return cv::imread(file_name).size();
+}
+
+cv::Mat decode_thumbnail(const std::string& file_name, int denominator) {
+	if (is_jpeg(file_name)) {
+		cv::Mat image = decode_jpeg(file_name, denominator);
+		if (!image.empty()) {
+			return image;
+		}
+	}
+	cv::Mat image = cv::imread(file_name);
+	if (!image.empty() && denominator > 1) {
+		cv::resize(image, image, cv::Size(), 1.0 / denominator,
+				1.0 / denominator, cv::INTER_AREA);
+	}
+	return image;
+}
+
+Thumbnail make_thumbnail(const std::string& file_name) {
+	Thumbnail thumbnail;
+	thumbnail.image = decode_thumbnail(file_name);
+	thumbnail.hash = 0;
+	thumbnail.sharpness = 0;
+	if (thumbnail.image.empty()) {
+		return thumbnail;
+	}
+	cv::Mat gray, small, laplacian;
+	cv::cvtColor(thumbnail.image, gray, CV_BGR2GRAY);
+	// Each bit tells if a pixel is brighter than its right neighbor
+	cv::resize(gray, small, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+	for (int y = 0; y < 8; y++) {
+		const uchar* row = small.ptr<uchar>(y);
+		for (int x = 0; x < 8; x++) {
+			thumbnail.hash = (thumbnail.hash << 1) | (row[x] > row[x + 1]);
+		}
+	}
+	cv::Laplacian(gray, laplacian, CV_32F);
+	cv::Scalar mean, stddev;
+	cv::meanStdDev(laplacian, mean, stddev);
+	thumbnail.sharpness = stddev[0] * stddev[0];
+	return thumbnail;
+}
+
+int hamming_distance(unsigned long long a, unsigned long long b) {
+	return __builtin_popcountll(a ^ b);
+}
+
+static std::string base_name(const std::string& path) {
+	return path.substr(path.find_last_of('/') + 1);
+}
+
+PrescreenResult prescreen(const std::vector<Thumbnail>& thumbnails,
+		const std::vector<std::string>& names, int max_distance,
+		double blur_ratio) {
+	int n = thumbnails.size();
+	PrescreenResult result;
+	result.duplicates = result.blurred = 0;
+	result.representative.resize(n);
+
+	// Group near-duplicates of the first image of each group, unreadable
+	// images are left to the decoder. Near-duplicates are not chained, or the
+	// small steps of a slow pan would collapse into one group
+	std::vector<int> group(n, -1);
+	for (int i = 0; i < n; i++) {
+		if (group[i] >= 0) {
+			continue;
+		}
+		group[i] = i;
+		if (thumbnails[i].image.empty()) {
+			continue;
+		}
+		for (int j = i + 1; j < n; j++) {
+			if (group[j] < 0 && !thumbnails[j].image.empty()
+					&& hamming_distance(thumbnails[i].hash, thumbnails[j].hash)
+							<= max_distance) {
+				group[j] = i;
+			}
+		}
+	}
+	// Sharpest image of each group
+	std::vector<int> sharpest(n, -1);
+	for (int i = 0; i < n; i++) {
+		int root = group[i];
+		if (sharpest[root] < 0
+				|| thumbnails[i].sharpness > thumbnails[sharpest[root]].sharpness) {
+			sharpest[root] = i;
+		}
+	}
+	for (int i = 0; i < n; i++) {
+		int kept = sharpest[group[i]];
+		result.representative[i] = kept;
+		if (kept != i) {
+			result.duplicates++;
+			std::ostringstream ostr;
+			ostr << "duplicate " << base_name(names[i]) << " of "
+					<< base_name(names[kept]) << " (distance "
+					<< hamming_distance(thumbnails[i].hash, thumbnails[kept].hash)
+					<< ")";
+			result.report.push_back(ostr.str());
+		}
+	}
+
+	// Blurred images compared to the median of kept ones
+	std::vector<double> scores;
+	for (int i = 0; i < n; i++) {
+		if (result.representative[i] == i && !thumbnails[i].image.empty()) {
+			scores.push_back(thumbnails[i].sharpness);
+		}
+	}
+	if (scores.empty()) {
+		return result;
+	}
+	std::nth_element(scores.begin(), scores.begin() + scores.size() / 2,
+			scores.end());
+	double threshold = blur_ratio * scores[scores.size() / 2];
+	std::vector<int> blurred;
+	for (int i = 0; i < n; i++) {
+		if (result.representative[i] == i && !thumbnails[i].image.empty()
+				&& thumbnails[i].sharpness < threshold) {
+			blurred.push_back(i);
+		}
+	}
+	int kept = 0;
+	for (int i = 0; i < n; i++) {
+		kept += result.representative[i] == i;
+	}
+	if (kept - int(blurred.size()) < 2) {
+		return result;
+	}
+	for (size_t k = 0; k < blurred.size(); k++) {
+		int i = blurred[k];
+		result.blurred++;
+		std::ostringstream ostr;
+		ostr << "blurred " << base_name(names[i]) << " (sharpness "
+				<< thumbnails[i].sharpness << " < " << threshold << ")";
+		result.report.push_back(ostr.str());
+		// Duplicates of a blurred image are blurred too
+		for (int j = 0; j < n; j++) {
+			if (result.representative[j] == i) {
+				result.representative[j] = -1;
+			}
+		}
+	}
+	return result;
+}
@@ -0,0 +1,60 @@
+/*
+ * Prescreen.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_PRESCREEN_H_
+#define SRC_PRESCREEN_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+/*
+ * Cheap look at an input image before decoding it fully
+ * image: BGR, about 1/8 of the original size, empty if the file can not be read
+ * hash: difference hash of the 9x8 gray image
+ * sharpness: variance of the Laplacian of the gray image
+ */
+struct Thumbnail {
+	cv::Mat image;
+	unsigned long long hash;
+	double sharpness;
+};
+
+/*
+ * Images kept by pre-screening
+ * representative: index of the image kept in place of each image, -1 if dropped
+ * report: one line per removed image
+ */
+struct PrescreenResult {
+	std::vector<int> representative;
+	std::vector<std::string> report;
+	int duplicates, blurred;
+};
+
+//Size of an image, JPEG files are not decoded
+cv::Size read_image_size(const std::string&);
+
+//Decode an image scaled down by 1/denominator (1, 2, 4 or 8), JPEG files are scaled while decoding
+cv::Mat decode_thumbnail(const std::string&, int = 8);
+
+//Decode a thumbnail and measure it
+Thumbnail make_thumbnail(const std::string&);
+
+//Number of different bits of two hashes
+int hamming_distance(unsigned long long, unsigned long long);
+
+/*
+ * Collapse near-duplicates (hash distance <= max_distance) into the sharpest
+ * one and drop images less sharp than blur_ratio * median sharpness. At least
+ * 2 images are kept. names: used by the report
+ */
+PrescreenResult prescreen(const std::vector<Thumbnail>&,
+		const std::vector<std::string>&, int = 4, double = 0.3);
+
+#endif /* SRC_PRESCREEN_H_ */
@@ -0,0 +1,219 @@
+/*
+ * RotationAveraging.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "RotationAveraging.h"
+
+//Chordal distance of a 5 degree rotation, pairs further away are down-weighted
+static const double chordal_scale = 2 * sqrt(2.0) * sin(2.5 * CV_PI / 180);
+
+//Relative rotation of a pair: R[to] = R[from] * R
+struct RelativeRotation {
+	int from, to;
+	cv::Mat R;
+	double inliers;
+};
+
+RotationAveragingEstimator::RotationAveragingEstimator(double conf,
+		int iterations) {
+	conf_thresh = conf;
+	max_iterations = iterations;
+}
+
+cv::Mat nearest_rotation(const cv::Mat& M) {
+	cv::Mat m;
+	M.convertTo(m, CV_64F);
+	cv::SVD svd(m);
+	cv::Mat R = svd.u * svd.vt;
+	if (cv::determinant(R) < 0) {
+		cv::Mat flip = cv::Mat::eye(3, 3, CV_64F);
+		flip.at<double>(2, 2) = -1;
+		R = svd.u * flip * svd.vt;
+	}
+	return R;
+}
+
+double consensus_focal(const std::vector<cv::detail::MatchesInfo>& pairwise_matches,
+		int num_images, double conf_thresh) {
+	std::vector<double> focals;
+	for (int i = 0; i < num_images; i++) {
+		for (int j = i + 1; j < num_images; j++) {
+			const cv::detail::MatchesInfo& m = pairwise_matches[i * num_images
+					+ j];
+			if (m.H.empty() || m.confidence < conf_thresh) {
+				continue;
+			}
+			double f0, f1;
+			bool f0_ok, f1_ok;
+			cv::detail::focalsFromHomography(m.H, f0, f1, f0_ok, f1_ok);
+			if (f0_ok && f1_ok) {
+				focals.push_back(sqrt(f0 * f1));
+			}
+		}
+	}
+	if (focals.empty()) {
+		return 0;
+	}
+	std::nth_element(focals.begin(), focals.begin() + focals.size() / 2,
+			focals.end());
+	return focals[focals.size() / 2];
+}
+
+/*
+ * Rotations minimising sum of weight * |R[to] - R[from] * R|^2 with R[ref] = I,
+ * projected on rotations. Each row of the rotations is an independent linear
+ * system sharing the same normal matrix, solved as 3 right hand sides.
+ * Return false if the pairs do not tie all images to ref
+ */
+static bool solve_rotations(const std::vector<RelativeRotation>& pairs,
+		const std::vector<double>& weights, int num_images, int ref,
+		std::vector<cv::Mat>& rotations) {
+	std::vector<int> index(num_images, -1);
+	int m = 0;
+	for (int i = 0; i < num_images; i++) {
+		if (i != ref) {
+			index[i] = 3 * m++;
+		}
+	}
+	cv::Mat_<double> H = cv::Mat::zeros(3 * m, 3 * m, CV_64F);
+	cv::Mat_<double> B = cv::Mat::zeros(3 * m, 3, CV_64F);
+	for (size_t p = 0; p < pairs.size(); p++) {
+		const cv::Mat_<double> A = pairs[p].R;
+		double w = weights[p];
+		int i = index[pairs[p].from], j = index[pairs[p].to];
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				if (j >= 0 && r == c) {
+					H(j + r, j + c) += w;
+				}
+				if (i >= 0) {
+					double AAt = 0;
+					for (int k = 0; k < 3; k++) {
+						AAt += A(r, k) * A(c, k);
+					}
+					H(i + r, i + c) += w * AAt;
+				}
+				if (i >= 0 && j >= 0) {
+					H(i + r, j + c) -= w * A(r, c);
+					H(j + c, i + r) -= w * A(r, c);
+				}
+				// Row c of the reference rotation is the unit vector e_c
+				if (i < 0 && j >= 0) {
+					B(j + r, c) += w * A(c, r);
+				}
+				if (j < 0 && i >= 0) {
+					B(i + r, c) += w * A(r, c);
+				}
+			}
+		}
+	}
+	cv::Mat X;
+	if (m > 0 && !cv::solve(H, B, X, cv::DECOMP_CHOLESKY)) {
+		return false;
+	}
+	cv::Mat_<double> rows = X;
+	rotations.resize(num_images);
+	for (int i = 0; i < num_images; i++) {
+		if (i == ref) {
+			rotations[i] = cv::Mat::eye(3, 3, CV_64F);
+			continue;
+		}
+		cv::Mat_<double> R(3, 3);
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				R(r, c) = rows(index[i] + c, r);
+			}
+		}
+		rotations[i] = nearest_rotation(R);
+	}
+	return true;
+}
+
+void RotationAveragingEstimator::estimate(
+		const std::vector<cv::detail::ImageFeatures>& features,
+		const std::vector<cv::detail::MatchesInfo>& pairwise_matches,
+		std::vector<cv::detail::CameraParams>& cameras) {
+	int num_images = static_cast<int>(features.size());
+	double focal = consensus_focal(pairwise_matches, num_images, conf_thresh);
+	if (focal <= 0) {
+		// Same guess as cv::detail::estimateFocal without any focal
+		for (int i = 0; i < num_images; i++) {
+			focal += features[i].img_size.width + features[i].img_size.height;
+		}
+		focal /= num_images;
+	}
+
+	// Homographies map centred points, so K has its principal point at 0
+	cv::Mat K = cv::Mat::eye(3, 3, CV_64F);
+	K.at<double>(0, 0) = K.at<double>(1, 1) = focal;
+	cv::Mat K_inv = K.inv();
+	std::vector<RelativeRotation> pairs;
+	std::vector<double> inliers(num_images, 0);
+	for (int i = 0; i < num_images; i++) {
+		for (int j = i + 1; j < num_images; j++) {
+			const cv::detail::MatchesInfo& m = pairwise_matches[i * num_images
+					+ j];
+			// As for the focal, false matches would drag the linear solve
+			if (m.H.empty() || m.num_inliers <= 0
+					|| m.confidence < conf_thresh) {
+				continue;
+			}
+			cv::Mat H;
+			m.H.convertTo(H, CV_64F);
+			RelativeRotation pair;
+			pair.from = i;
+			pair.to = j;
+			pair.R = nearest_rotation(K_inv * H.inv() * K);
+			pair.inliers = m.num_inliers;
+			pairs.push_back(pair);
+			inliers[i] += m.num_inliers;
+			inliers[j] += m.num_inliers;
+		}
+	}
+	// The best connected image is the reference, like the centre of a spanning tree
+	int ref = std::max_element(inliers.begin(), inliers.end())
+			- inliers.begin();
+
+	std::vector<double> weights(pairs.size());
+	for (size_t p = 0; p < pairs.size(); p++) {
+		weights[p] = pairs[p].inliers;
+	}
+	std::vector<cv::Mat> rotations;
+	for (int iteration = 0; iteration < max_iterations; iteration++) {
+		std::vector<cv::Mat> previous = rotations;
+		if (!solve_rotations(pairs, weights, num_images, ref, rotations)) {
+			cv::detail::HomographyBasedEstimator fallback;
+			fallback(features, pairwise_matches, cameras);
+			return;
+		}
+		// Cauchy weights of the chordal distances left by each pair
+		for (size_t p = 0; p < pairs.size(); p++) {
+			double d = cv::norm(
+					rotations[pairs[p].to] - rotations[pairs[p].from] * pairs[p].R)
+					/ chordal_scale;
+			weights[p] = pairs[p].inliers / (1 + d * d);
+		}
+		if (previous.empty()) {
+			continue;
+		}
+		double change = 0;
+		for (int i = 0; i < num_images; i++) {
+			change = std::max(change, cv::norm(rotations[i] - previous[i]));
+		}
+		if (change < 1e-6) {
+			break;
+		}
+	}
+
+	cameras.assign(num_images, cv::detail::CameraParams());
+	for (int i = 0; i < num_images; i++) {
+		cameras[i].focal = focal;
+		cameras[i].aspect = 1;
+		cameras[i].ppx = 0.5 * features[i].img_size.width;
+		cameras[i].ppy = 0.5 * features[i].img_size.height;
+		rotations[i].convertTo(cameras[i].R, CV_32F);
+	}
+}
@@ -0,0 +1,45 @@
+/*
+ * RotationAveraging.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_ROTATIONAVERAGING_H_
+#define SRC_ROTATIONAVERAGING_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/stitching/detail/autocalib.hpp>
+#include <opencv2/stitching/detail/motion_estimators.hpp>
+
+/*
+ * Camera estimator solving all rotations at once instead of chaining them
+ * along a spanning tree. Every matched pair gives a relative rotation from its
+ * homography and a consensus focal length; the chordal distances of all pairs
+ * are minimised by a linear least squares, projected on rotations, and
+ * reweighted so pairs disagreeing with the others lose their influence.
+ * Falls back to cv::detail::HomographyBasedEstimator if the system is singular.
+ */
+class RotationAveragingEstimator: public cv::detail::Estimator {
+public:
+	RotationAveragingEstimator(double = 1.0, int = 10);
+
+private:
+	void estimate(const std::vector<cv::detail::ImageFeatures>&,
+			const std::vector<cv::detail::MatchesInfo>&,
+			std::vector<cv::detail::CameraParams>&);
+
+	double conf_thresh; //minimum confidence of pairs voting for the focal length and rotations
+	int max_iterations; //reweighting passes
+};
+
+//Rotation nearest to a 3x3 matrix in Frobenius norm, CV_64F
+cv::Mat nearest_rotation(const cv::Mat&);
+
+//Median focal length of homographies of pairs above a confidence, 0 if none
+double consensus_focal(const std::vector<cv::detail::MatchesInfo>&, int,
+		double);
+
+#endif /* SRC_ROTATIONAVERAGING_H_ */
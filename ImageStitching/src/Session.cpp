@@ -0,0 +1,235 @@
+/*
+ * Session.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "Session.h"
+
+static void write_rect(cv::FileStorage& fs, const std::string& name,
+		const cv::Rect& rect) {
+	fs << name << "[" << rect.x << rect.y << rect.width << rect.height << "]";
+}
+
+static cv::Rect read_rect(const cv::FileNode& node) {
+	return cv::Rect(int(node[0]), int(node[1]), int(node[2]), int(node[3]));
+}
+
+//Keypoints as rows of x, y, size, angle, response, octave
+static cv::Mat keypoints_mat(const std::vector<cv::KeyPoint>& keypoints) {
+	cv::Mat_<float> mat((int) keypoints.size(), 6);
+	for (size_t i = 0; i < keypoints.size(); i++) {
+		const cv::KeyPoint& p = keypoints[i];
+		float row[] = { p.pt.x, p.pt.y, p.size, p.angle, p.response,
+				float(p.octave) };
+		std::copy(row, row + 6, mat[i]);
+	}
+	return mat;
+}
+
+static std::vector<cv::KeyPoint> mat_keypoints(const cv::Mat_<float>& mat) {
+	std::vector<cv::KeyPoint> keypoints(mat.rows);
+	for (int i = 0; i < mat.rows; i++) {
+		const float* row = mat[i];
+		keypoints[i] = cv::KeyPoint(row[0], row[1], row[2], row[3], row[4],
+				int(row[5]));
+	}
+	return keypoints;
+}
+
+//Matches as rows of queryIdx, trainIdx, distance
+static cv::Mat matches_mat(const std::vector<cv::DMatch>& matches) {
+	cv::Mat_<float> mat((int) matches.size(), 3);
+	for (size_t i = 0; i < matches.size(); i++) {
+		mat(i, 0) = float(matches[i].queryIdx);
+		mat(i, 1) = float(matches[i].trainIdx);
+		mat(i, 2) = matches[i].distance;
+	}
+	return mat;
+}
+
+static std::vector<cv::DMatch> mat_matches(const cv::Mat_<float>& mat) {
+	std::vector<cv::DMatch> matches(mat.rows);
+	for (int i = 0; i < mat.rows; i++) {
+		matches[i] = cv::DMatch(int(mat(i, 0)), int(mat(i, 1)), mat(i, 2));
+	}
+	return matches;
+}
+
+//Matches of dst to src from matches of src to dst
+static cv::detail::MatchesInfo dual_matches(
+		const cv::detail::MatchesInfo& info) {
+	cv::detail::MatchesInfo dual = info;
+	std::swap(dual.src_img_idx, dual.dst_img_idx);
+	if (!info.H.empty()) {
+		dual.H = info.H.inv();
+	}
+	for (size_t i = 0; i < dual.matches.size(); i++) {
+		std::swap(dual.matches[i].queryIdx, dual.matches[i].trainIdx);
+	}
+	return dual;
+}
+
+bool Session::save(const std::string& file_name) const {
+	cv::FileStorage fs(file_name, cv::FileStorage::WRITE);
+	if (!fs.isOpened()) {
+		return false;
+	}
+	fs << "warp_type" << warp_type;
+	fs << "blend_type" << blend_type;
+	fs << "max_bands" << max_bands;
+	fs << "orientation" << orientation;
+	write_rect(fs, "input_size",
+			cv::Rect(0, 0, input_size.width, input_size.height));
+	write_rect(fs, "full_img_sizes",
+			cv::Rect(0, 0, full_img_sizes.width, full_img_sizes.height));
+	fs << "compose_scale" << compose_scale;
+	fs << "warped_image_scale" << warped_image_scale;
+	write_rect(fs, "canvas", canvas);
+	write_rect(fs, "dst_roi", dst_roi);
+	fs << "img_paths" << "[";
+	for (size_t i = 0; i < img_paths.size(); i++) {
+		fs << img_paths[i];
+	}
+	fs << "]";
+	fs << "cameras" << "[";
+	for (size_t i = 0; i < cameras.size(); i++) {
+		fs << "{" << "focal" << cameras[i].focal << "aspect"
+				<< cameras[i].aspect << "ppx" << cameras[i].ppx << "ppy"
+				<< cameras[i].ppy << "R" << cameras[i].R << "t" << cameras[i].t
+				<< "}";
+	}
+	fs << "]";
+	fs << "seam_masks" << "[";
+	for (size_t i = 0; i < seam_masks.size(); i++) {
+		fs << seam_masks[i];
+	}
+	fs << "]";
+	fs << "gains" << "[";
+	for (size_t i = 0; i < gains.size(); i++) {
+		fs << gains[i];
+	}
+	fs << "]";
+	fs << "work_scale" << work_scale;
+	fs << "seam_work_aspect" << seam_work_aspect;
+	fs << "features" << "[";
+	for (size_t i = 0; i < features.size(); i++) {
+		fs << "{" << "width" << features[i].img_size.width << "height"
+				<< features[i].img_size.height;
+		if (!features[i].keypoints.empty()) {
+			fs << "keypoints" << keypoints_mat(features[i].keypoints)
+					<< "descriptors" << features[i].descriptors;
+		}
+		fs << "}";
+	}
+	fs << "]";
+	fs << "pairwise_matches" << "[";
+	int n = features.size();
+	for (int i = 0; i < n; i++) {
+		for (int j = i + 1; j < n && size_t(n * n) == pairwise_matches.size();
+				j++) {
+			const cv::detail::MatchesInfo& info = pairwise_matches[i * n + j];
+			if (info.num_inliers <= 0 || info.H.empty()) {
+				continue;
+			}
+			fs << "{" << "src" << i << "dst" << j << "matches"
+					<< matches_mat(info.matches) << "inliers"
+					<< cv::Mat(info.inliers_mask) << "num_inliers"
+					<< info.num_inliers << "H" << info.H << "confidence"
+					<< info.confidence << "}";
+		}
+	}
+	fs << "]";
+	return true;
+}
+
+bool Session::load(const std::string& file_name) {
+	cv::FileStorage fs(file_name, cv::FileStorage::READ);
+	if (!fs.isOpened()) {
+		return false;
+	}
+	fs["warp_type"] >> warp_type;
+	fs["blend_type"] >> blend_type;
+	fs["max_bands"] >> max_bands;
+	fs["orientation"] >> orientation;
+	input_size = read_rect(fs["input_size"]).size();
+	full_img_sizes = read_rect(fs["full_img_sizes"]).size();
+	fs["compose_scale"] >> compose_scale;
+	fs["warped_image_scale"] >> warped_image_scale;
+	canvas = read_rect(fs["canvas"]);
+	dst_roi = read_rect(fs["dst_roi"]);
+
+	img_paths.clear();
+	cv::FileNode node = fs["img_paths"];
+	for (cv::FileNodeIterator i = node.begin(); i != node.end(); ++i) {
+		img_paths.push_back(std::string(*i));
+	}
+	cameras.clear();
+	node = fs["cameras"];
+	for (cv::FileNodeIterator i = node.begin(); i != node.end(); ++i) {
+		cv::detail::CameraParams camera;
+		(*i)["focal"] >> camera.focal;
+		(*i)["aspect"] >> camera.aspect;
+		(*i)["ppx"] >> camera.ppx;
+		(*i)["ppy"] >> camera.ppy;
+		(*i)["R"] >> camera.R;
+		(*i)["t"] >> camera.t;
+		cameras.push_back(camera);
+	}
+	seam_masks.clear();
+	node = fs["seam_masks"];
+	for (cv::FileNodeIterator i = node.begin(); i != node.end(); ++i) {
+		cv::Mat mask;
+		*i >> mask;
+		seam_masks.push_back(mask);
+	}
+	gains.clear();
+	node = fs["gains"];
+	for (cv::FileNodeIterator i = node.begin(); i != node.end(); ++i) {
+		gains.push_back(double(*i));
+	}
+	fs["work_scale"] >> work_scale;
+	fs["seam_work_aspect"] >> seam_work_aspect;
+	features.clear();
+	node = fs["features"];
+	for (cv::FileNodeIterator i = node.begin(); i != node.end(); ++i) {
+		cv::detail::ImageFeatures feature;
+		feature.img_idx = features.size();
+		feature.img_size = cv::Size(int((*i)["width"]), int((*i)["height"]));
+		cv::Mat keypoints;
+		(*i)["keypoints"] >> keypoints;
+		feature.keypoints = mat_keypoints(keypoints);
+		(*i)["descriptors"] >> feature.descriptors;
+		features.push_back(feature);
+	}
+	int n = features.size();
+	pairwise_matches.assign(n * n, cv::detail::MatchesInfo());
+	for (int i = 0; i < n; i++) {
+		pairwise_matches[i * n + i].src_img_idx = i;
+		pairwise_matches[i * n + i].dst_img_idx = i;
+	}
+	node = fs["pairwise_matches"];
+	for (cv::FileNodeIterator i = node.begin(); i != node.end(); ++i) {
+		cv::detail::MatchesInfo info;
+		info.src_img_idx = int((*i)["src"]);
+		info.dst_img_idx = int((*i)["dst"]);
+		if (info.src_img_idx < 0 || info.dst_img_idx >= n
+				|| info.src_img_idx >= info.dst_img_idx) {
+			continue;
+		}
+		cv::Mat matches, inliers;
+		(*i)["matches"] >> matches;
+		info.matches = mat_matches(matches);
+		(*i)["inliers"] >> inliers;
+		info.inliers_mask.assign(inliers.datastart, inliers.dataend);
+		(*i)["num_inliers"] >> info.num_inliers;
+		(*i)["H"] >> info.H;
+		(*i)["confidence"] >> info.confidence;
+		pairwise_matches[info.src_img_idx * n + info.dst_img_idx] = info;
+		pairwise_matches[info.dst_img_idx * n + info.src_img_idx] =
+				dual_matches(info);
+	}
+	return img_paths.size() == cameras.size()
+			&& cameras.size() == seam_masks.size();
+}
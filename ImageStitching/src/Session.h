@@ -0,0 +1,46 @@
+/*
+ * Session.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_SESSION_H_
+#define SRC_SESSION_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/stitching/detail/camera.hpp>
+#include <opencv2/stitching/detail/matchers.hpp>
+
+/*
+ * Registration state of a stitched panorama, enough to render any region of
+ * it again without registration and to add images to it later. Saved with
+ * cv::FileStorage, use a .yml.gz file name to keep seam masks small.
+ */
+struct Session {
+	int warp_type, blend_type, max_bands;
+	//Exif orientation and size of inputs before it is applied
+	int orientation;
+	cv::Size input_size, full_img_sizes;
+	//Resize of original images and scale of the canvas at compositing
+	double compose_scale;
+	float warped_image_scale;
+	//Whole canvas and the region written as output, at compositing
+	cv::Rect canvas, dst_roi;
+	std::vector<std::string> img_paths;
+	std::vector<cv::detail::CameraParams> cameras; //at compositing
+	std::vector<cv::Mat> seam_masks; //at seam estimation
+	std::vector<double> gains; //empty if exposure is not compensated by gain
+	//Registration resolution and seam estimation resolution relative to it
+	double work_scale, seam_work_aspect;
+	std::vector<cv::detail::ImageFeatures> features; //at registration
+	//n*n as outputs of pairwise matching, only pairs having inliers are saved
+	std::vector<cv::detail::MatchesInfo> pairwise_matches;
+
+	bool save(const std::string&) const;
+	bool load(const std::string&);
+};
+
+#endif /* SRC_SESSION_H_ */
@@ -0,0 +1,228 @@
+/*
+ * StatusChannel.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "StatusChannel.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static_assert(sizeof(StatusRecord) == 128, "status layout changed");
+static_assert(offsetof(StatusRecord, ratio) == 40, "status layout changed");
+static_assert(offsetof(StatusRecord, stage_name) == 64,
+		"status layout changed");
+
+static double unix_time() {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec / 1e6;
+}
+
+StatusChannel::StatusChannel() {
+	record = NULL;
+	stage_begin = 0;
+	stage_span = 0;
+}
+
+StatusChannel::~StatusChannel() {
+	close();
+}
+
+bool StatusChannel::open(const std::string& path) {
+	close();
+	// Not truncated: pollers may still map the record of a previous job
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	void* data = MAP_FAILED;
+	if (ftruncate(fd, sizeof(StatusRecord)) == 0) {
+		data = mmap(NULL, sizeof(StatusRecord), PROT_READ | PROT_WRITE,
+				MAP_SHARED, fd, 0);
+	}
+	::close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	record = static_cast<StatusRecord*>(data);
+	__atomic_store_n(&record->magic, 0, __ATOMIC_RELEASE);
+	begin_write();
+	record->version = status_version;
+	record->stage = -1;
+	record->attempt = 0;
+	record->return_code = -1;
+	__atomic_store_n(&record->items_done, 0, __ATOMIC_RELAXED);
+	record->items_total = 0;
+	__atomic_store_n(&record->progress, 0, __ATOMIC_RELAXED);
+	record->pid = getpid();
+	record->ratio = -1;
+	record->started = record->updated = unix_time();
+	strncpy(record->stage_name, "feed", sizeof(record->stage_name));
+	end_write();
+	__atomic_store_n(&record->magic, status_magic, __ATOMIC_RELEASE);
+	return true;
+}
+
+void StatusChannel::close() {
+	if (record) {
+		munmap(record, sizeof(StatusRecord));
+		record = NULL;
+	}
+}
+
+bool StatusChannel::is_open() const {
+	return record != NULL;
+}
+
+void StatusChannel::set_weights(const std::vector<double>& weights) {
+	double total = 0;
+	for (size_t i = 0; i < weights.size(); i++) {
+		total += std::max(weights[i], 0.0);
+	}
+	begins.assign(weights.size(), 0);
+	spans.assign(weights.size(), 0);
+	double begin = 0;
+	for (size_t i = 0; i < weights.size() && total > 0; i++) {
+		begins[i] = begin;
+		spans[i] = std::max(weights[i], 0.0) / total;
+		begin += spans[i];
+	}
+}
+
+void StatusChannel::begin_write() {
+	// Writers wait for each other, readers never wait for writers
+	uint32_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_RELAXED);
+	do {
+		sequence &= ~1u;
+	} while (!__atomic_compare_exchange_n(&record->sequence, &sequence,
+			sequence + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void StatusChannel::end_write() {
+	__atomic_fetch_add(&record->sequence, 1, __ATOMIC_RELEASE);
+}
+
+void StatusChannel::raise_progress(double share) {
+	int32_t value = static_cast<int32_t>(std::min(std::max(share, 0.0), 1.0)
+			* 10000);
+	int32_t current = __atomic_load_n(&record->progress, __ATOMIC_RELAXED);
+	while (current < value
+			&& !__atomic_compare_exchange_n(&record->progress, &current, value,
+					true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+
+void StatusChannel::set_stage(int stage, const char* name, int items) {
+	if (!record) {
+		return;
+	}
+	bool weighted = stage >= 0 && size_t(stage) < spans.size();
+	stage_begin = weighted ? begins[stage] : 0;
+	stage_span = weighted ? spans[stage] : 0;
+	begin_write();
+	record->stage = stage;
+	__atomic_store_n(&record->items_done, 0, __ATOMIC_RELAXED);
+	record->items_total = items;
+	record->updated = unix_time();
+	strncpy(record->stage_name, name, sizeof(record->stage_name) - 1);
+	record->stage_name[sizeof(record->stage_name) - 1] = '\0';
+	end_write();
+	raise_progress(stage_begin);
+}
+
+void StatusChannel::advance(int items) {
+	if (!record) {
+		return;
+	}
+	int32_t done = __atomic_add_fetch(&record->items_done, items,
+			__ATOMIC_RELAXED);
+	int32_t total = record->items_total;
+	if (total > 0) {
+		raise_progress(stage_begin
+				+ stage_span * std::min(done, total) / double(total));
+	}
+}
+
+void StatusChannel::set_attempt(int attempt) {
+	if (!record) {
+		return;
+	}
+	begin_write();
+	record->attempt = attempt;
+	record->updated = unix_time();
+	end_write();
+	__atomic_store_n(&record->progress, 0, __ATOMIC_RELAXED);
+}
+
+void StatusChannel::set_result(int code, double ratio, int done_stage) {
+	if (!record) {
+		return;
+	}
+	begin_write();
+	record->stage = done_stage;
+	record->return_code = code;
+	record->ratio = ratio;
+	record->items_total = 0;
+	record->updated = unix_time();
+	strncpy(record->stage_name, "done", sizeof(record->stage_name));
+	end_write();
+	raise_progress(1);
+}
+
+const StatusRecord* map_status(const std::string& path) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	void* data = MAP_FAILED;
+	if (lseek(fd, 0, SEEK_END) >= off_t(sizeof(StatusRecord))) {
+		data = mmap(NULL, sizeof(StatusRecord), PROT_READ, MAP_SHARED, fd, 0);
+	}
+	::close(fd);
+	return data == MAP_FAILED ? NULL : static_cast<const StatusRecord*>(data);
+}
+
+void unmap_status(const StatusRecord* record) {
+	if (record) {
+		munmap(const_cast<StatusRecord*>(record), sizeof(StatusRecord));
+	}
+}
+
+bool read_status(const StatusRecord* record, StatusSnapshot& snapshot) {
+	if (!record
+			|| __atomic_load_n(&record->magic, __ATOMIC_ACQUIRE) != status_magic) {
+		return false;
+	}
+	for (int tries = 0; tries < 1000; tries++) {
+		uint32_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+		if (sequence & 1) {
+			continue;
+		}
+		StatusRecord copy;
+		memcpy(&copy, record, sizeof(StatusRecord));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&record->sequence, __ATOMIC_RELAXED) != sequence) {
+			continue;
+		}
+		snapshot.stage = copy.stage;
+		snapshot.attempt = copy.attempt;
+		snapshot.return_code = copy.return_code;
+		snapshot.items_done = copy.items_done;
+		snapshot.items_total = copy.items_total;
+		snapshot.pid = copy.pid;
+		snapshot.percent = copy.progress / 100.0;
+		snapshot.ratio = copy.ratio;
+		snapshot.started = copy.started;
+		snapshot.updated = copy.updated;
+		copy.stage_name[sizeof(copy.stage_name) - 1] = '\0';
+		snapshot.stage_name = copy.stage_name;
+		return true;
+	}
+	return false;
+}
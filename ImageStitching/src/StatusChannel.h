@@ -0,0 +1,103 @@
+/*
+ * StatusChannel.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_STATUSCHANNEL_H_
+#define SRC_STATUSCHANNEL_H_
+
+#include <bits/stdc++.h>
+
+/*
+ * Fixed layout of a job's status file, 128 bytes in host byte order, mapped
+ * by pollers in any language. Writers never lock: single words are updated
+ * atomically, and fields changed together are guarded by a sequence lock.
+ * A reader copies the record and retries if sequence was odd or changed.
+ *
+ *   0 magic        'STAT' (0x54415453), written last when the file is ready
+ *   4 version      1
+ *   8 sequence     odd while fields from stage to updated are being written
+ *  12 stage        stage index, -1 before the first, number of stages when done
+ *  16 attempt      0 for the 1st pass, 1 for the retry at finer resolution
+ *  20 return_code  Stitcher::ReturnCode of the finished job, -1 while running
+ *  24 items_done   images of the stage done so far, atomic
+ *  28 items_total  images of the stage, 0 if it is not counted
+ *  32 progress     percent of the attempt done * 100, atomic, never decreases
+ *  36 pid          process writing the file
+ *  40 ratio        ratio of images in the panorama, -1 if unknown
+ *  48 started      Unix time the job started, in seconds
+ *  56 updated      Unix time of the last stage change
+ *  64 stage_name   NUL terminated
+ */
+struct StatusRecord {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t sequence;
+	int32_t stage;
+	int32_t attempt;
+	int32_t return_code;
+	int32_t items_done;
+	int32_t items_total;
+	int32_t progress;
+	int32_t pid;
+	double ratio;
+	double started;
+	double updated;
+	char stage_name[16];
+	char reserved[48];
+};
+
+const uint32_t status_magic = 0x54415453;
+const uint32_t status_version = 1;
+
+//Consistent copy of a status record
+struct StatusSnapshot {
+	int stage, attempt, return_code, items_done, items_total, pid;
+	double percent, ratio, started, updated;
+	std::string stage_name;
+};
+
+/*
+ * Writer of a job's status file. Stage changes and results come from one
+ * thread at a time, items are counted by any number of threads.
+ */
+class StatusChannel {
+public:
+	StatusChannel();
+	virtual ~StatusChannel();
+
+	//Create the file or resize it to one record, and map it
+	bool open(const std::string&);
+	void close();
+	bool is_open() const;
+
+	//Relative cost of every stage, e.g. predicted seconds, for the progress
+	void set_weights(const std::vector<double>&);
+	//Enter a stage of a number of items to count, 0 for none
+	void set_stage(int, const char*, int);
+	//Count items of the current stage done
+	void advance(int = 1);
+	//Start the retry, progress starts over
+	void set_attempt(int);
+	//Finish the job with a return code, a ratio and a stage meaning done
+	void set_result(int, double, int);
+
+private:
+	void begin_write();
+	void end_write();
+	void raise_progress(double);
+
+	StatusRecord* record;
+	std::vector<double> begins, spans; //share of an attempt before and in each stage
+	double stage_begin, stage_span;
+};
+
+//Map a status file for polling, NULL if it can not be read
+const StatusRecord* map_status(const std::string&);
+void unmap_status(const StatusRecord*);
+//Copy a mapped record, false if writers kept changing it or it is not ready
+bool read_status(const StatusRecord*, StatusSnapshot&);
+
+#endif /* SRC_STATUSCHANNEL_H_ */
@@ -7,46 +7,136 @@
 
 #include "Stitcher.h"
 
+//Files shared with band workers
+static const std::string shared_dir = "/dev/shm/";
+
+//Buckets of recorded histograms
+static const Metrics::Buckets seconds_buckets = { 0.01, 0.05, 0.1, 0.25, 0.5,
+		1, 2.5, 5, 10, 25, 60, 120 };
+static const Metrics::Buckets count_buckets = { 2, 4, 8, 16, 32, 64, 128 };
+static const Metrics::Buckets feature_buckets = { 100, 250, 500, 1000, 2000,
+		5000, 10000 };
+static const Metrics::Buckets inlier_buckets = { 0, 6, 10, 20, 50, 100, 200,
+		500 };
+static const Metrics::Buckets ratio_buckets = { 0.1, 0.2, 0.3, 0.4, 0.5, 0.6,
+		0.7, 0.8, 0.9, 0.99, 1 };
+static const Metrics::Buckets megapixel_buckets = { 1, 5, 10, 25, 50, 100,
+		200 };
+
 int compareCvSize(const cv::Size& size_1, const cv::Size& size_2) {
 	return (size_1.area() < size_2.area());
 }
 
+cv::Ptr<cv::detail::FeaturesFinder> Stitcher::create_finder() {
+	LOG_INFO("Find features with expected: ");
+	int num_features = int((work_scale * work_scale * full_img_sizes.area()) / 100);
+	LOG_INFO("%d\n", num_features);
+	return new cv::detail::OrbFeaturesFinder(cv::Size(3, 1), num_features, 1.3f,
+			5);
+}
+
 void Stitcher::find_features(std::vector<cv::detail::ImageFeatures>& features) {
-#if ON_LOGGER
-	printf("Find features with expected: ");
-#endif
 	work_scale = std::min(1.0,
-			sqrt(registration_resol * 1e6 / full_img[0].size().area()));
+			sqrt(registration_resol * 1e6 / full_img_sizes.area()));
 	double seam_scale = std::min(1.0,
-			sqrt(seam_estimation_resol * 1e6 / full_img[0].size().area()));
+			sqrt(seam_estimation_resol * 1e6 / full_img_sizes.area()));
 	seam_work_aspect = seam_scale / work_scale;
-	int num_features = int(
-			(work_scale * work_scale * full_img[0].size().area()) / 100);
-#if ON_LOGGER
-	printf("%d\n", num_features);
-#endif
-	cv::Ptr<cv::detail::FeaturesFinder> finder =
-			new cv::detail::OrbFeaturesFinder(cv::Size(3, 1), num_features,
-					1.3f, 5);
+	cv::Ptr<cv::detail::FeaturesFinder> finder = create_finder();
 
 #pragma omp parallel for
 	for (int i = 0; i < num_images; ++i) {
-		if (registration_resol <= 0) {
-			img[i] = full_img[i];
-		} else {
-			cv::resize(full_img[i], img[i], cv::Size(), work_scale, work_scale);
+		if (cancelled()) {
+			continue;
 		}
+		img[i] = view_img(i, registration_resol <= 0 ? 1 : work_scale);
 		(*finder)(img[i], features[i]);
-#if ON_DETAIL
-		printf("	i%d %dx%d: %d features\n", i, img[i].rows, img[i].cols,
+		LOG_DETAIL("	i%d %dx%d: %d features\n", i, img[i].rows, img[i].cols,
 				int(features[i].keypoints.size()));
-#endif
 		features[i].img_idx = i;
-		cv::resize(full_img[i], img[i], cv::Size(), seam_scale, seam_scale);
-		images[i] = img[i].clone();
+		images[i] = view_img(i, seam_scale);
+		status_channel.advance();
 	}
 	img.clear();
 	finder->collectGarbage();
+	if (metrics) {
+		for (int i = 0; i < num_images; ++i) {
+			metrics->observe("stitch_features_per_image", "",
+					features[i].keypoints.size(), feature_buckets);
+		}
+	}
+}
+
+void Stitcher::rematch_weak(std::vector<cv::detail::ImageFeatures>& features,
+		std::vector<cv::detail::MatchesInfo>& pairwise_matches) {
+	std::vector<int> component = biggest_component(pairwise_matches,
+			num_images, confidence_threshold);
+	std::vector<bool> weak(num_images, true);
+	for (size_t i = 0; i < component.size(); i++) {
+		weak[component[i]] = false;
+	}
+	if (int(component.size()) == num_images) {
+		return;
+	}
+	LOG_INFO("Re-match %d images at finer resolution\n",
+			num_images - int(component.size()));
+	// Features of weak images at twice the registration resolution, in work scale
+	begin_stage(STAGE_FEATURES);
+	double fine_scale = std::min(1.0,
+			sqrt(2 * registration_resol * 1e6 / full_img_sizes.area()));
+	double saved_scale = work_scale;
+	work_scale = fine_scale;
+	cv::Ptr<cv::detail::FeaturesFinder> finder = create_finder();
+	work_scale = saved_scale;
+	float factor = static_cast<float>(work_scale / fine_scale);
+#pragma omp parallel for
+	for (int i = 0; i < num_images; i++) {
+		if (!weak[i]) {
+			continue;
+		}
+		cv::Mat fine = view_img(i, fine_scale);
+		cv::Size work_size = features[i].img_size;
+		(*finder)(fine, features[i]);
+		for (size_t k = 0; k < features[i].keypoints.size(); k++) {
+			features[i].keypoints[k].pt *= factor;
+			features[i].keypoints[k].size *= factor;
+		}
+		features[i].img_size = work_size;
+		features[i].img_idx = i;
+	}
+	finder->collectGarbage();
+	end_stage(STAGE_FEATURES);
+
+	// Match again only pairs having a weak image
+	begin_stage(STAGE_MATCHING);
+	cv::Mat mask(num_images, num_images, CV_8U, cv::Scalar(0));
+	bool masked = matching_mask.rows == num_images;
+	for (int i = 0; i < num_images; i++) {
+		for (int j = i + 1; j < num_images; j++) {
+			if ((weak[i] || weak[j])
+					&& (!masked || matching_mask.at<uchar>(i, j))) {
+				mask.at<uchar>(i, j) = 1;
+			}
+		}
+	}
+	std::vector<cv::detail::MatchesInfo> rematched;
+	cv::detail::BestOf2NearestMatcher matcher;
+	matcher(features, rematched, mask);
+	matcher.collectGarbage();
+	for (int i = 0; i < num_images; i++) {
+		for (int j = i + 1; j < num_images; j++) {
+			if (mask.at<uchar>(i, j)) {
+				pairwise_matches[i * num_images + j] = rematched[i * num_images
+						+ j];
+				pairwise_matches[j * num_images + i] = rematched[j * num_images
+						+ i];
+			}
+		}
+	}
+	end_stage(STAGE_MATCHING);
+	if (metrics) {
+		metrics->inc("stitch_rematched_images_total", "",
+				num_images - component.size());
+	}
 }
 
 void Stitcher::extract_biggest_component(
@@ -58,78 +148,311 @@ void Stitcher::extract_biggest_component(
 	std::vector<cv::Mat> img_subset(indices.size());
 	std::vector<cv::Size> full_img_sizes_subset(indices.size());
 	std::vector<cv::Mat> full_img_subset(indices.size());
-#if ON_LOGGER
-	printf("Biggest component: ");
-#endif
+	std::vector<std::string> img_paths_subset(indices.size());
+	LOG_INFO("Biggest component: ");
 #pragma omp parallel for
 	for (size_t i = 0; i < indices.size(); ++i) {
-#if ON_LOGGER
-		printf("%d ", indices[i]);
-#endif
+		LOG_INFO("%d ", indices[i]);
 		img_subset[i] = images[indices[i]];
 		full_img_subset[i] = full_img[indices[i]];
+		img_paths_subset[i] = img_paths[indices[i]];
 	}
 	images = img_subset;
 	full_img = full_img_subset;
-#if ON_LOGGER
-	printf("\n");
-#endif
+	img_paths = img_paths_subset;
+	LOG_INFO("\n");
+}
+
+std::vector<std::vector<int> > Stitcher::find_components(
+		const std::vector<cv::detail::MatchesInfo>& pairwise_matches) {
+	// Same links as leaveBiggestComponent
+	cv::detail::DisjointSets sets(num_images);
+	for (int i = 0; i < num_images; i++) {
+		for (int j = i + 1; j < num_images; j++) {
+			if (pairwise_matches[i * num_images + j].confidence
+					< confidence_threshold) {
+				continue;
+			}
+			int a = sets.findSetByElem(i), b = sets.findSetByElem(j);
+			if (a != b) {
+				sets.mergeSets(a, b);
+			}
+		}
+	}
+	std::map<int, std::vector<int> > members;
+	for (int i = 0; i < num_images; i++) {
+		members[sets.findSetByElem(i)].push_back(i);
+	}
+	std::vector<std::vector<int> > components;
+	for (auto& set : members) {
+		if (set.second.size() >= 2) {
+			components.push_back(set.second);
+		}
+	}
+	std::stable_sort(components.begin(), components.end(),
+			[](const std::vector<int>& a, const std::vector<int>& b) {
+				return a.size() > b.size();
+			});
+	return components;
+}
+
+//Features and matches of some images, renumbered in their order
+static void subset_matches(const std::vector<int>& indices,
+		const std::vector<cv::detail::ImageFeatures>& features,
+		const std::vector<cv::detail::MatchesInfo>& pairwise_matches,
+		std::vector<cv::detail::ImageFeatures>& features_subset,
+		std::vector<cv::detail::MatchesInfo>& matches_subset) {
+	int n = features.size(), m = indices.size();
+	features_subset.resize(m);
+	matches_subset.resize(m * m);
+	for (int k = 0; k < m; k++) {
+		features_subset[k] = features[indices[k]];
+		features_subset[k].img_idx = k;
+		for (int l = 0; l < m; l++) {
+			cv::detail::MatchesInfo& info = matches_subset[k * m + l];
+			info = pairwise_matches[indices[k] * n + indices[l]];
+			info.src_img_idx = k;
+			info.dst_img_idx = l;
+		}
+	}
+}
+
+//Threads of each component by its number of images, by largest remainder so
+//they add up to threads. A component always gets 1, which may exceed threads
+static std::vector<int> thread_shares(
+		const std::vector<std::vector<int> >& components, int threads) {
+	int covered = 0;
+	for (size_t c = 0; c < components.size(); c++) {
+		covered += components[c].size();
+	}
+	std::vector<int> shares(components.size());
+	std::vector<std::pair<double, int> > remainders;
+	int given = 0;
+	for (size_t c = 0; c < components.size(); c++) {
+		double quota = double(threads) * components[c].size() / covered;
+		shares[c] = static_cast<int>(quota);
+		given += shares[c];
+		remainders.push_back(std::make_pair(quota - shares[c], int(c)));
+	}
+	std::stable_sort(remainders.begin(), remainders.end(),
+			[](const std::pair<double, int>& a, const std::pair<double, int>& b) {
+				return a.first > b.first;
+			});
+	for (size_t k = 0; given < threads && k < remainders.size(); k++, given++) {
+		shares[remainders[k].second]++;
+	}
+	for (size_t c = 0; c < components.size(); c++) {
+		shares[c] = std::max(shares[c], 1);
+	}
+	return shares;
+}
+
+void Stitcher::split_components(
+		std::vector<cv::detail::ImageFeatures>& features,
+		std::vector<cv::detail::MatchesInfo>& pairwise_matches) {
+	std::vector<std::vector<int> > components = find_components(
+			pairwise_matches);
+	if (components.size() < 2) {
+		extract_biggest_component(features, pairwise_matches);
+		return;
+	}
+	LOG_INFO("Components:");
+	for (size_t c = 0; c < components.size(); c++) {
+		LOG_INFO(" %d", int(components[c].size()));
+	}
+	LOG_INFO("\n");
+	// Every component gets a share of the threads by its number of images,
+	// this stitcher keeps its share until join_parts
+	shared_threads = omp_get_max_threads();
+	std::vector<int> shares = thread_shares(components, shared_threads);
+	for (size_t c = 1; c < components.size(); c++) {
+		const std::vector<int>& indices = components[c];
+		cv::Ptr<Stitcher> part = new Stitcher();
+		part->registration_resol = registration_resol;
+		part->seam_estimation_resol = seam_estimation_resol;
+		part->compositing_resol = compositing_resol;
+		part->confidence_threshold = confidence_threshold;
+		part->expos_comp_type = expos_comp_type;
+		part->blend_type = blend_type;
+		part->seam_work_aspect = seam_work_aspect;
+		part->work_scale = work_scale;
+		part->warp_type = warp_type;
+		part->seam_find_type = seam_find_type;
+		part->max_bands = max_bands;
+		part->crop_output = crop_output;
+		part->rotation_averaging = rotation_averaging;
+		part->wrap_around = wrap_around;
+		part->overlap_blend = overlap_blend;
+		part->full_img_sizes = full_img_sizes;
+		part->input_size = input_size;
+		part->orientation = orientation;
+		part->cancel_token = cancel_token;
+		part->result_dst = result_dst + "_" + std::to_string(c);
+		if (!session_path.empty()) {
+			part->session_path = part->result_dst + ".yml.gz";
+		}
+		part->mat_pool.set_huge_pages(mat_pool.get_huge_pages());
+		part->num_images = indices.size();
+		for (size_t k = 0; k < indices.size(); k++) {
+			part->images.push_back(images[indices[k]]);
+			part->full_img.push_back(full_img[indices[k]]);
+			part->img_paths.push_back(img_paths[indices[k]]);
+		}
+		std::vector<cv::detail::ImageFeatures> part_features;
+		std::vector<cv::detail::MatchesInfo> part_matches;
+		subset_matches(indices, features, pairwise_matches, part_features,
+				part_matches);
+		parts.push_back(part);
+		part_threads.push_back(
+				std::thread(&Stitcher::stitch_part, static_cast<Stitcher*>(part),
+						part_features, part_matches, shares[c]));
+	}
+	omp_set_num_threads(shares[0]);
+
+	// This stitcher goes on with the biggest component
+	const std::vector<int>& indices = components[0];
+	std::vector<cv::detail::ImageFeatures> features_subset;
+	std::vector<cv::detail::MatchesInfo> matches_subset;
+	subset_matches(indices, features, pairwise_matches, features_subset,
+			matches_subset);
+	features = features_subset;
+	pairwise_matches = matches_subset;
+	std::vector<cv::Mat> img_subset, full_img_subset;
+	std::vector<std::string> img_paths_subset;
+	for (size_t k = 0; k < indices.size(); k++) {
+		img_subset.push_back(images[indices[k]]);
+		full_img_subset.push_back(full_img[indices[k]]);
+		img_paths_subset.push_back(img_paths[indices[k]]);
+	}
+	images = img_subset;
+	full_img = full_img_subset;
+	img_paths = img_paths_subset;
+}
+
+void Stitcher::stitch_part(std::vector<cv::detail::ImageFeatures> features,
+		std::vector<cv::detail::MatchesInfo> pairwise_matches, int threads) {
+	omp_set_num_threads(threads);
+	LOG_INFO("Stitch component %s of %d images\n", result_dst.c_str(),
+			num_images);
+	std::vector<cv::detail::CameraParams> cameras;
+	begin_stage(STAGE_ESTIMATE);
+	estimate_camera(features, pairwise_matches, cameras);
+	end_stage(STAGE_ESTIMATE);
+	if (!cancelled()) {
+		begin_stage(STAGE_REFINE);
+		refine_camera(features, pairwise_matches, cameras);
+		end_stage(STAGE_REFINE);
+	}
+	if (!session_path.empty()) {
+		session.features = features;
+		session.pairwise_matches = pairwise_matches;
+	}
+	features.clear();
+	pairwise_matches.clear();
+	if (!cancelled()) {
+		part_result = compositing(cameras);
+	}
+	// Every image of a component is in its panorama
+	status = {OK, 1.0};
+	if (cancelled()) {
+		status.first = part_result.empty() ? CANCELLED : NOT_ENOUGH;
+	} else if (part_result.rows * part_result.cols <= 1) {
+		status.first = FAILED;
+	}
+	collect_garbage();
+}
+
+void Stitcher::join_parts() {
+	for (size_t k = 0; k < part_threads.size(); k++) {
+		part_threads[k].join();
+	}
+	if (!part_threads.empty()) {
+		omp_set_num_threads(shared_threads);
+	}
+	part_threads.clear();
+}
+
+void Stitcher::write_parts() {
+	join_parts();
+	if (parts.empty()) {
+		return;
+	}
+	// One line per panorama: output, images and status
+	std::ofstream list((result_dst + ".components").c_str());
+	list << result_dst << ".jpg " << num_images << " " << get_status()
+			<< "\n";
+	for (size_t k = 0; k < parts.size(); k++) {
+		Stitcher& part = *parts[k];
+		if (!part.part_result.empty() && part.status.first != FAILED) {
+			part.write_result(part.part_result);
+			part.write_session();
+		}
+		LOG_INFO("Component %s: %d images, %s\n", part.result_dst.c_str(),
+				part.num_images, part.get_status().c_str());
+		list << part.result_dst << ".jpg " << part.num_images << " "
+				<< part.get_status() << "\n";
+	}
+	parts.clear();
 }
 
 void Stitcher::match_pairwise(std::vector<cv::detail::ImageFeatures>& features,
 		std::vector<cv::detail::MatchesInfo>& pairwise_matches) {
-#if ON_LOGGER
-	printf("Match pairwise: ");
-#endif
+	LOG_INFO("Match pairwise: ");
 	cv::detail::BestOf2NearestMatcher matcher;
 	if (matching_mask.rows * matching_mask.cols <= 1) {
 		matcher(features, pairwise_matches);
-#if ON_LOGGER
-		printf("no matching mask\n");
-#endif
+		LOG_INFO("no matching mask\n");
 	} else {
 		matcher(features, pairwise_matches, matching_mask);
-#if ON_LOGGER
-		printf("use matching mask\n");
-#endif
+		LOG_INFO("use matching mask\n");
 	}
-#if ON_DETAIL
+	count_pairs(pairwise_matches);
+	matcher.collectGarbage();
+}
+
+void Stitcher::count_pairs(
+		const std::vector<cv::detail::MatchesInfo>& pairwise_matches) {
+	job.overlap_pairs = 0;
 	for (auto i : pairwise_matches) {
 		if (i.src_img_idx < i.dst_img_idx) {
-			printf("	%d %d: %d\n", i.src_img_idx, i.dst_img_idx, i.num_inliers);
+			LOG_DETAIL("	%d %d: %d\n", i.src_img_idx, i.dst_img_idx, i.num_inliers);
+			if (i.confidence > confidence_threshold) {
+				job.overlap_pairs++;
+			}
+			if (metrics) {
+				metrics->observe("stitch_pair_inliers", "", i.num_inliers,
+						inlier_buckets);
+			}
 		}
 	}
-
-#endif
-	matcher.collectGarbage();
 }
 
 void Stitcher::estimate_camera(std::vector<cv::detail::ImageFeatures>& features,
 		std::vector<cv::detail::MatchesInfo>& pairwise_matches,
 		std::vector<cv::detail::CameraParams>& cameras) {
-	printf("Estimate camera\n");
-	cv::detail::HomographyBasedEstimator estimator;
-	estimator(features, pairwise_matches, cameras);
+	LOG_INFO("Estimate camera\n");
+	cv::Ptr<cv::detail::Estimator> estimator;
+	if (rotation_averaging) {
+		estimator = new RotationAveragingEstimator(confidence_threshold);
+	} else {
+		estimator = new cv::detail::HomographyBasedEstimator();
+	}
+	(*estimator)(features, pairwise_matches, cameras);
 #pragma omp parallel for
 	for (size_t i = 0; i < cameras.size(); ++i) {
 		cv::Mat R;
 		cameras[i].R.convertTo(R, CV_32F);
 		cameras[i].R = R;
-#if ON_DETAIL
-		printf("	Convert camera %ld rotation\n", i);
-#endif
+		LOG_DETAIL("	Convert camera %ld rotation\n", i);
 	}
 
 }
 
-void Stitcher::refine_camera(
+void Stitcher::adjust_bundle(
 		const std::vector<cv::detail::ImageFeatures>& features,
 		const std::vector<cv::detail::MatchesInfo>& pairwise_matches,
 		std::vector<cv::detail::CameraParams>& cameras) {
-#if ON_LOGGER
-	printf("Refine camera\n");
-	printf("	Run bundle adjustment\n");
-#endif
+	LOG_INFO("	Run bundle adjustment\n");
 	cv::Ptr<cv::detail::BundleAdjusterBase> adjuster;
 	adjuster = new cv::detail::BundleAdjusterRay();
 	adjuster->setConfThresh(confidence_threshold);
@@ -143,9 +466,15 @@ void Stitcher::refine_camera(
 
 	adjuster->setRefinementMask(refine_mask);
 	(*adjuster)(features, pairwise_matches, cameras);
-#if ON_LOGGER
-	printf("	Find median focal length: ");
-#endif
+}
+
+void Stitcher::refine_camera(
+		const std::vector<cv::detail::ImageFeatures>& features,
+		const std::vector<cv::detail::MatchesInfo>& pairwise_matches,
+		std::vector<cv::detail::CameraParams>& cameras) {
+	LOG_INFO("Refine camera\n");
+	adjust_bundle(features, pairwise_matches, cameras);
+	LOG_INFO("	Find median focal length: ");
 	// Find median focal length
 	std::vector<double> focals(cameras.size());
 #pragma omp parallel for
@@ -170,13 +499,9 @@ void Stitcher::refine_camera(
 		}
 	}
 
-#if ON_LOGGER
-	printf("%f\n", warped_image_scale);
-#endif
+	LOG_INFO("%f\n", warped_image_scale);
 	focals.clear();
-#if ON_LOGGER
-	printf("	Do wave correction\n");
-#endif
+	LOG_INFO("	Do wave correction\n");
 	std::vector<cv::Mat> rmats(cameras.size());
 #pragma omp parallel for
 	for (unsigned int i = 0; i < cameras.size(); i++) {
@@ -190,10 +515,14 @@ void Stitcher::refine_camera(
 	rmats.clear();
 }
 
+bool Stitcher::loop_aware() const {
+	// Sessions and band workers place images as warped
+	return wrap_around && (warp_type == CYLINDRICAL || warp_type == SPHERICAL)
+			&& session_path.empty() && band_workers <= 1;
+}
+
 void Stitcher::create_warper(cv::Ptr<cv::WarperCreator>& warper_creator) {
-#if ON_LOGGER
-	printf("Create warper\n");
-#endif
+	LOG_INFO("Create warper\n");
 	switch (warp_type) {
 	case PLANE:
 		warper_creator = new cv::PlaneWarper();
@@ -243,27 +572,48 @@ void Stitcher::create_warper(cv::Ptr<cv::WarperCreator>& warper_creator) {
 	}
 }
 
+cv::Rect Stitcher::warp_part(const cv::Ptr<cv::detail::RotationWarper>& warper,
+		float scale, const cv::Mat& src, const cv::Mat& K, const cv::Mat& R,
+		const cv::Rect& roi, const cv::Rect& region, cv::Mat& dst,
+		cv::Mat& dst_mask) {
+	if (src.type() == CV_8UC3) {
+		switch (warp_type) {
+		case PLANE:
+			return warp_projected<PlaneProjection>(src, K, R, scale, roi,
+					region, dst, dst_mask);
+		case CYLINDRICAL:
+			return warp_projected<CylindricalProjection>(src, K, R, scale, roi,
+					region, dst, dst_mask);
+		case SPHERICAL:
+			return warp_projected<SphericalProjection>(src, K, R, scale, roi,
+					region, dst, dst_mask);
+		case MERCATOR:
+			return warp_projected<MercatorProjection>(src, K, R, scale, roi,
+					region, dst, dst_mask);
+		default:
+			break;
+		}
+	}
+	return warp_region(warper, src, K, R, region, dst, dst_mask);
+}
+
 std::vector<cv::Mat> Stitcher::warp_img(std::vector<cv::Point>& corners,
 		const cv::Ptr<cv::WarperCreator>& warper_creator,
 		std::vector<cv::Size>& sizes, std::vector<cv::Mat>& masks_warped,
 		std::vector<cv::detail::CameraParams>& cameras,
 		cv::Ptr<cv::detail::ExposureCompensator>& compensator) {
-#if ON_LOGGER
-	printf("Warp images\n");
-#endif
-	std::vector<cv::Mat> masks(num_images);
-#pragma omp parallel for
-	for (int i = 0; i < num_images; ++i) {
-		masks[i].create(images[i].size(), CV_8U);
-		masks[i].setTo(cv::Scalar::all(255));
-	}
+	LOG_INFO("Warp images\n");
 	// Warp images and their masks
 	std::vector<cv::Mat> images_warped_f(num_images);
 	std::vector<cv::Mat> images_warped(num_images);
 #pragma omp parallel for
 	for (int i = 0; i < num_images; ++i) {
+		if (cancelled()) {
+			continue;
+		}
+		float scale = static_cast<float>(warped_image_scale * seam_work_aspect);
 		cv::Ptr<cv::detail::RotationWarper> warper = warper_creator->create(
-				static_cast<float>(warped_image_scale * seam_work_aspect));
+				scale);
 		cv::Mat_<float> K;
 		cameras[i].K().convertTo(K, CV_32F);
 		float swa = (float) seam_work_aspect;
@@ -272,37 +622,48 @@ std::vector<cv::Mat> Stitcher::warp_img(std::vector<cv::Point>& corners,
 		K(1, 1) *= swa;
 		K(1, 2) *= swa;
 
-		corners[i] = warper->warp(images[i], K, cameras[i].R, cv::INTER_LINEAR,
-				cv::BORDER_REFLECT, images_warped[i]);
-		sizes[i] = images_warped[i].size();
-
-		warper->warp(masks[i], K, cameras[i].R, cv::INTER_NEAREST,
-				cv::BORDER_CONSTANT, masks_warped[i]);
+		cv::Mat R = loop.empty() ? cameras[i].R : loop.facing(i, cameras[i].R,
+				scale);
+		mat_pool.attach(images_warped[i]);
+		mat_pool.attach(images_warped_f[i]);
+		mat_pool.attach(masks_warped[i]);
+		cv::Rect roi = warper->warpRoi(images[i].size(), K, R);
+		roi = warp_part(warper, scale, images[i], K, R, roi, roi,
+				images_warped[i], masks_warped[i]);
+		corners[i] = roi.tl();
+		sizes[i] = roi.size();
 		images_warped[i].convertTo(images_warped_f[i], CV_32F);
-#if ON_DETAIL
-		printf("	Warp image and mask %d\n", i);
-#endif
+		status_channel.advance();
+		LOG_DETAIL("	Warp image and mask %d\n", i);
 	}
-#if ON_LOGGER
-	printf("Feed exposure compensator\n");
-#endif
+	if (cancelled()) {
+		return images_warped_f;
+	}
+	if (!loop.empty()) {
+		float scale = static_cast<float>(warped_image_scale * seam_work_aspect);
+		std::vector<cv::Rect> rois;
+		for (int i = 0; i < num_images; i++) {
+			rois.push_back(cv::Rect(corners[i], sizes[i]));
+		}
+		bool closed = loop.close(rois, scale);
+		for (int i = 0; i < num_images; i++) {
+			corners[i].x += loop.offset(i, scale);
+		}
+		if (closed) {
+			LOG_INFO("	Loop closed, %d columns\n", loop.width(scale));
+		}
+	}
+	LOG_INFO("Feed exposure compensator\n");
 	compensator = cv::detail::ExposureCompensator::createDefault(
 			expos_comp_type);
 	compensator->feed(corners, images_warped, masks_warped);
 	images_warped.clear();
-	masks.clear();
 
 	return images_warped_f;
 
 }
 
-void Stitcher::find_seam(std::vector<cv::Mat>& images_warped_f,
-		const std::vector<cv::Point>& corners,
-		std::vector<cv::Mat>& masks_warped) {
-#if ON_LOGGER
-	printf("Find seam\n");
-#endif
-	// Prepare images masks
+cv::Ptr<cv::detail::SeamFinder> Stitcher::create_seam_finder() {
 	cv::Ptr<cv::detail::SeamFinder> seam_finder;
 	switch (seam_find_type) {
 	case NO:
@@ -328,7 +689,40 @@ void Stitcher::find_seam(std::vector<cv::Mat>& images_warped_f,
 				cv::detail::DpSeamFinder::COLOR_GRAD);
 		break;
 	}
-	seam_finder->find(images_warped_f, corners, masks_warped);
+	return seam_finder;
+}
+
+void Stitcher::find_seam(std::vector<cv::Mat>& images_warped_f,
+		const std::vector<cv::Point>& corners,
+		std::vector<cv::Mat>& masks_warped) {
+	LOG_INFO("Find seam\n");
+	if (loop.closed()) {
+		// Images crossing the wrap also meet images at the other edge
+		std::vector<cv::Mat> images_all(images_warped_f), masks_all(masks_warped);
+		std::vector<cv::Point> corners_all(corners), copies;
+		std::vector<int> source;
+		wrap_copies(corners, masks_warped,
+				loop.width(warped_image_scale * seam_work_aspect), source,
+				copies);
+		for (size_t k = 0; k < source.size(); k++) {
+			images_all.push_back(images_warped_f[source[k]]);
+			masks_all.push_back(masks_warped[source[k]].clone());
+			corners_all.push_back(copies[k]);
+		}
+		create_seam_finder()->find(images_all, corners_all, masks_all);
+		for (int i = 0; i < num_images; i++) {
+			masks_warped[i] = masks_all[i];
+		}
+		// An image keeps what both it and its copy keep
+		for (size_t k = 0; k < source.size(); k++) {
+			and_masks(masks_warped[source[k]], masks_all[num_images + k],
+					masks_warped[source[k]]);
+		}
+		images.clear();
+		return;
+	}
+	// Prepare images masks
+	create_seam_finder()->find(images_warped_f, corners, masks_warped);
 	// Release unused memory
 	images.clear();
 }
@@ -336,14 +730,12 @@ void Stitcher::find_seam(std::vector<cv::Mat>& images_warped_f,
 double Stitcher::resize_mask(const cv::Ptr<cv::WarperCreator>& warper_creator,
 		std::vector<cv::Point>& corners, std::vector<cv::Size>& sizes,
 		std::vector<cv::detail::CameraParams>& cameras) {
-#if ON_LOGGER
-	printf("Resize mask\n");
-#endif
+	LOG_INFO("Resize mask\n");
 	double compose_scale = 1;
 	double compose_work_aspect = 1;
 	if (compositing_resol > 0) {
 		compose_scale = std::min(1.0,
-				sqrt(compositing_resol * 1e6 / full_img[0].size().area()));
+				sqrt(compositing_resol * 1e6 / full_img_sizes.area()));
 	}
 
 	// Compute relative scales
@@ -370,272 +762,440 @@ double Stitcher::resize_mask(const cv::Ptr<cv::WarperCreator>& warper_creator,
 
 		cv::Mat K;
 		cameras[i].K().convertTo(K, CV_32F);
-		cv::Rect roi = warper->warpRoi(sz, K, cameras[i].R);
-		corners[i] = roi.tl();
-		sizes[i] = roi.size();
+		if (loop.empty()) {
+			cv::Rect roi = warper->warpRoi(sz, K, cameras[i].R);
+			corners[i] = roi.tl();
+			sizes[i] = roi.size();
+		} else {
+			cv::Rect roi = warper->warpRoi(sz, K,
+					loop.facing(i, cameras[i].R, warped_image_scale));
+			corners[i] = roi.tl()
+					+ cv::Point(loop.offset(i, warped_image_scale), 0);
+			sizes[i] = roi.size();
+		}
 	}
 	return compose_scale;
 
 }
 
-cv::Ptr<cv::detail::Blender> Stitcher::prepare_blender(
+std::vector<cv::Rect> Stitcher::loop_overlaps(
 		const std::vector<cv::Point>& corners,
-		const std::vector<cv::Size>& sizes) {
-#if ON_LOGGER
-	printf("Prepare blender\n");
-#endif
+		const std::vector<cv::Mat>& masks_warped) {
+	int width = loop.width(warped_image_scale * seam_work_aspect);
+	std::vector<cv::Point> corners_all(corners), copies;
+	std::vector<cv::Mat> masks_all(masks_warped);
+	std::vector<int> source;
+	wrap_copies(corners, masks_warped, width, source, copies);
+	for (size_t k = 0; k < source.size(); k++) {
+		corners_all.push_back(copies[k]);
+		masks_all.push_back(masks_warped[source[k]]);
+	}
+	// Blending places images a turn to each side too
+	std::vector<cv::Rect> found = overlap_rects(corners_all, masks_all);
+	std::vector<cv::Rect> overlaps;
+	for (size_t i = 0; i < found.size(); i++) {
+		for (int copy = -1; copy <= 1; copy++) {
+			overlaps.push_back(found[i] + cv::Point(copy * width, 0));
+		}
+	}
+	return overlaps;
+}
+
+cv::Ptr<cv::detail::Blender> Stitcher::prepare_blender(
+		const cv::Rect& dst_roi, const cv::Size& canvas_size) {
+	LOG_INFO("Prepare blender\n");
 	// Update corners and sizes
-	cv::Ptr<cv::detail::Blender> blender = cv::detail::Blender::createDefault(
-			blend_type, false);
-	cv::Size dst_sz = cv::detail::resultRoi(corners, sizes).size();
-	float blend_width = sqrt(static_cast<float>(dst_sz.area())) * 5 / 100.f;
+	cv::Ptr<cv::detail::Blender> blender;
+	if (blend_type == FastFeatherBlender::FAST_FEATHER) {
+		blender = new FastFeatherBlender();
+	} else if (blend_type == OverlapBlender::OVERLAP_MULTI_BAND) {
+		blender = new OverlapBlender();
+	} else {
+		blender = cv::detail::Blender::createDefault(blend_type, false);
+	}
+	cv::Size dst_sz = canvas_size;
+	float blend_width = canvas_blend_width(dst_sz);
 	if (blend_width < 1.f) {
 		blender = cv::detail::Blender::createDefault(cv::detail::Blender::NO,
 		false);
 	} else {
-		if (blend_type == cv::detail::Blender::MULTI_BAND) {
-			cv::detail::MultiBandBlender* mb =
-					dynamic_cast<cv::detail::MultiBandBlender*>(static_cast<cv::detail::Blender*>(blender));
-			mb->setNumBands(
-					static_cast<int>(ceil(log(blend_width) / log(2.)) - 1.));
-#if ON_LOGGER
-			printf("	Number of bands: %d\n", mb->numBands());
-#endif
+		if (blend_type == cv::detail::Blender::MULTI_BAND
+				|| blend_type == OverlapBlender::OVERLAP_MULTI_BAND) {
+			int num_bands = static_cast<int>(ceil(log(blend_width) / log(2.))
+					- 1.);
+			if (max_bands > 0) {
+				num_bands = std::min(num_bands, max_bands);
+			}
+			if (blend_type == cv::detail::Blender::MULTI_BAND) {
+				cv::detail::MultiBandBlender* mb =
+						dynamic_cast<cv::detail::MultiBandBlender*>(static_cast<cv::detail::Blender*>(blender));
+				mb->setNumBands(num_bands);
+			} else {
+				OverlapBlender* ob =
+						dynamic_cast<OverlapBlender*>(static_cast<cv::detail::Blender*>(blender));
+				ob->setNumBands(num_bands);
+			}
+			LOG_INFO("	Number of bands: %d\n", num_bands);
 		} else {
 			if (blend_type == cv::detail::Blender::FEATHER) {
 				cv::detail::FeatherBlender* fb =
 						dynamic_cast<cv::detail::FeatherBlender*>(static_cast<cv::detail::Blender*>(blender));
 				fb->setSharpness(1.f / blend_width);
-#if ON_LOGGER
-				printf("	Sharpness: %f\n", fb->sharpness());
-#endif
+				LOG_INFO("	Sharpness: %f\n", fb->sharpness());
+			} else if (blend_type == FastFeatherBlender::FAST_FEATHER) {
+				FastFeatherBlender* fb =
+						dynamic_cast<FastFeatherBlender*>(static_cast<cv::detail::Blender*>(blender));
+				fb->setSharpness(1.f / blend_width);
 			}
 		}
 	}
-	blender->prepare(corners, sizes);
+	blender->prepare(dst_roi);
 
 	return blender;
 }
 
+void Stitcher::set_overlaps(const cv::Ptr<cv::detail::Blender>& blender,
+		const std::vector<cv::Rect>& overlaps, double scale) {
+	OverlapBlender* ob =
+			dynamic_cast<OverlapBlender*>(static_cast<cv::detail::Blender*>(blender));
+	if (!ob) {
+		return;
+	}
+	std::vector<cv::Rect> rects;
+	for (size_t i = 0; i < overlaps.size(); i++) {
+		cv::Point tl(cvFloor(overlaps[i].x * scale),
+				cvFloor(overlaps[i].y * scale));
+		cv::Point br(cvCeil(overlaps[i].br().x * scale),
+				cvCeil(overlaps[i].br().y * scale));
+		rects.push_back(cv::Rect(tl, br));
+	}
+	ob->set_overlaps(rects);
+	LOG_INFO("	%d overlaps blended by pyramids\n", int(overlaps.size()));
+}
+
 void Stitcher::blend_img(const double& compose_scale,
 		const cv::Ptr<cv::WarperCreator>& warper_creator,
 		cv::Ptr<cv::detail::ExposureCompensator>& compensator,
-		cv::vector<cv::Point>& corners, std::vector<cv::Mat>& masks_warped,
+		cv::vector<cv::Point>& corners, const std::vector<cv::Size>& sizes,
+		std::vector<cv::Mat>& masks_warped, const cv::Rect& dst_roi,
 		cv::Ptr<cv::detail::Blender>& blender,
 		std::vector<cv::detail::CameraParams>& cameras, cv::Mat& result) {
-#if ON_LOGGER
-	printf("Blend pano\n");
-#endif
-	img.resize(num_images);
+	LOG_INFO("Blend pano\n");
+	int fed = 0;
 #pragma omp parallel for
 	for (int img_idx = 0; img_idx < num_images; ++img_idx) {
-#if ON_DETAIL
-		printf("	Resize image\n");
-#endif
-		// Read image and resize it if necessary
+		// Skip images outside of the output, and the rest once cancelled
+		cv::Rect roi(corners[img_idx], sizes[img_idx]);
+		// All columns of an image of a closed loop, it is also placed a turn
+		// away, but only rows of the output
+		int turn = loop.closed() ? loop.width(warped_image_scale) : 0;
+		cv::Rect region = turn > 0 ?
+				roi & cv::Rect(roi.x, dst_roi.y, roi.width, dst_roi.height) :
+				roi & dst_roi;
+		if (region.area() <= 0 || cancelled()) {
+			continue;
+		}
+		LOG_DETAIL("	Resize image\n");
+		// Warp the decoded pixels, orientation and size live in the camera
+		cv::Size sz = full_img_sizes;
 		if (abs(compose_scale - 1) > 1e-1) {
-			cv::resize(full_img[img_idx], img[img_idx], cv::Size(),
-					compose_scale, compose_scale);
-		} else {
-			img[img_idx] = full_img[img_idx];
+			sz.width = cvRound(sz.width * compose_scale);
+			sz.height = cvRound(sz.height * compose_scale);
 		}
-		cv::Size img_size = img[img_idx].size();
+		cv::detail::CameraParams camera;
+		cv::Mat src = warp_source(img_idx, sz, cameras[img_idx], camera);
 
 		cv::Mat K;
-		cameras[img_idx].K().convertTo(K, CV_32F);
-#if ON_DETAIL
-		printf("	Warp image\n");
-#endif
-		// Warp the current image
+		camera.K().convertTo(K, CV_32F);
+		cv::Point offset(0, 0);
+		if (!loop.empty()) {
+			camera.R = loop.facing(img_idx, camera.R, warped_image_scale);
+			offset.x = loop.offset(img_idx, warped_image_scale);
+		}
+		LOG_DETAIL("	Warp image\n");
+		// Warp the part of current image and its mask inside the output
 		cv::Ptr<cv::detail::RotationWarper> warper = warper_creator->create(
 				warped_image_scale);
-		cv::Mat img_warped;
-		warper->warp(img[img_idx], K, cameras[img_idx].R, cv::INTER_LINEAR,
-				cv::BORDER_REFLECT, img_warped);
-
-#if ON_DETAIL
-		printf("	Warp mask\n");
-#endif
-		// Warp the current image mask
-		cv::Mat mask;
-		mask.create(img_size, CV_8U);
-		mask.setTo(cv::Scalar::all(255));
-		cv::Mat mask_warped;
-		warper->warp(mask, K, cameras[img_idx].R, cv::INTER_NEAREST,
-				cv::BORDER_CONSTANT, mask_warped);
-		mask.release();
-#if ON_DETAIL
-		printf("	Compensate exposure\n");
-#endif
+		cv::Mat img_warped, mask_warped;
+		mat_pool.attach(img_warped);
+		mat_pool.attach(mask_warped);
+		cv::Rect part = warp_part(warper, warped_image_scale, src, K, camera.R,
+				warper->warpRoi(src.size(), K, camera.R), region - offset,
+				img_warped, mask_warped) + offset;
+		src.release();
+		LOG_DETAIL("	Compensate exposure\n");
 		// Compensate exposure
-		compensator->apply(img_idx, corners[img_idx], img_warped, mask_warped);
+		compensator->apply(img_idx, part.tl(), img_warped, mask_warped);
 		cv::Mat img_warped_s;
-		img_warped.convertTo(img_warped_s, CV_16S);
+		widen_to_16s(img_warped, mat_pool.attach(img_warped_s));
 		img_warped.release();
 		cv::Mat dilated_mask;
 		dilate(masks_warped[img_idx], dilated_mask, cv::Mat());
 		cv::Mat seam_mask;
-		cv::resize(dilated_mask, seam_mask, mask_warped.size());
+		mat_pool.attach(seam_mask);
+		cv::resize(dilated_mask, seam_mask, roi.size());
 		dilated_mask.release();
-		mask_warped = seam_mask & mask_warped;
+		and_masks(seam_mask(part - roi.tl()), mask_warped, mask_warped);
 		seam_mask.release();
 		// Blend the current image
-#if ON_DETAIL
-		printf("	Image %d feeded\n", img_idx);
-#endif
-		blender->feed(img_warped_s, mask_warped, corners[img_idx]);
+		LOG_DETAIL("	Image %d feeded\n", img_idx);
+#pragma omp critical
+		{
+			// A closed loop also feeds the image a turn to each side
+			int copies = turn > 0 ? 1 : 0;
+			for (int copy = -copies; copy <= copies; copy++) {
+				cv::Point shift(copy * turn, 0);
+				cv::Rect placed = (part + shift) & dst_roi;
+				if (placed.area() > 0) {
+					cv::Rect inside = placed - shift - part.tl();
+					blender->feed(img_warped_s(inside), mask_warped(inside),
+							placed.tl());
+				}
+			}
+			fed++;
+		}
+		status_channel.advance();
 		mask_warped.release();
 		img_warped_s.release();
 	}
+	// Images fed before cancellation still make a partial output
+	if (fed == 0 && cancelled()) {
+		return;
+	}
 	cv::Mat result_mask;
 	blender->blend(result, result_mask);
 }
 
+cv::Mat Stitcher::preview_seams(const std::vector<cv::Mat>& images_warped_f,
+		const std::vector<cv::Point>& corners,
+		const std::vector<cv::Mat>& masks_warped) {
+	std::vector<cv::Point> warped_corners;
+	std::vector<cv::Size> warped_sizes;
+	for (int i = 0; i < num_images; i++) {
+		if (!images_warped_f[i].empty()) {
+			warped_corners.push_back(corners[i]);
+			warped_sizes.push_back(images_warped_f[i].size());
+		}
+	}
+	if (warped_corners.empty()) {
+		return cv::Mat();
+	}
+	LOG_INFO("Preview %d warped images at seam estimation resolution\n",
+			int(warped_corners.size()));
+	cv::detail::Blender blender;
+	blender.prepare(warped_corners, warped_sizes);
+	for (int i = 0; i < num_images; i++) {
+		if (!images_warped_f[i].empty()) {
+			cv::Mat image_s;
+			images_warped_f[i].convertTo(image_s, CV_16S);
+			blender.feed(image_s, masks_warped[i], corners[i]);
+		}
+	}
+	cv::Mat result, result_mask;
+	blender.blend(result, result_mask);
+	result.convertTo(result, CV_8U);
+	return result;
+}
+
+bool Stitcher::cancelled() {
+	return cancel_token && cancel_token->expired();
+}
+
 int Stitcher::registration(std::vector<cv::detail::CameraParams>& cameras) {
-#if ON_LOGGER
-	long long start;
-	printf("=========================================================\n");
-	printf("Registration stage\n");
-#endif
+	LOG_INFO("=========================================================\n");
+	LOG_INFO("Registration stage\n");
 	int retVal = 1; //1 is normal, 0 is not enough, -1 is failed
 	img.resize(num_images);
 	images.resize(num_images);
 
 	cv::vector<cv::detail::ImageFeatures> features(num_images);
-#if ON_LOGGER
-	start = cv::getTickCount();
-#endif
-	find_features(features);
-#if ON_LOGGER
-	printf("%lf\n",
-			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
-
 	cv::vector<cv::detail::MatchesInfo> pairwise_matches;
-#if ON_LOGGER
-	start = cv::getTickCount();
-#endif
-	match_pairwise(features, pairwise_matches);
-#if ON_LOGGER
-	printf("%lf\n",
-			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+	if (task_graph) {
+		register_graph(features, pairwise_matches);
+	} else {
+		begin_stage(STAGE_FEATURES);
+		find_features(features);
+		end_stage(STAGE_FEATURES);
 
-#if ON_LOGGER
-	start = cv::getTickCount();
-#endif
-	// Leave only images we are sure are from the same panorama
-	extract_biggest_component(features, pairwise_matches);
-#if ON_LOGGER
-	printf("%lf\n",
-			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+		if (cancelled()) {
+			return -1;
+		}
+		begin_stage(STAGE_MATCHING);
+		match_pairwise(features, pairwise_matches);
+		end_stage(STAGE_MATCHING);
+	}
+	if (hierarchical && !cancelled()) {
+		rematch_weak(features, pairwise_matches);
+	}
+	if (cancelled()) {
+		return -1;
+	}
+
+	begin_stage(STAGE_COMPONENT);
+	if (all_components) {
+		// Other components are stitched by parts meanwhile
+		split_components(features, pairwise_matches);
+	} else {
+		// Leave only images we are sure are from the same panorama
+		extract_biggest_component(features, pairwise_matches);
+	}
+	end_stage(STAGE_COMPONENT);
 
-	// Check if we still have enough images
+	// Check if we still have enough images, in any panorama
 	int tmp = static_cast<int>(images.size());
-	status.second = double(tmp) / num_images;
+	int covered = tmp;
+	for (size_t k = 0; k < parts.size(); k++) {
+		covered += parts[k]->num_images;
+	}
+	status.second = double(covered) / num_images;
 	if (tmp < 2) {
 		return -1;
 	}
-	if (tmp < num_images) {
-		num_images = tmp;
+	if (covered < num_images) {
 		retVal = 0;
 	}
-#if ON_LOGGER
-	start = cv::getTickCount();
-#endif
+	num_images = tmp;
+	begin_stage(STAGE_ESTIMATE);
 	estimate_camera(features, pairwise_matches, cameras);
-#if ON_LOGGER
-	printf("%lf\n",
-			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+	end_stage(STAGE_ESTIMATE);
+	// Bundle adjustment can not be interrupted, do not start it late
+	if (cancelled()) {
+		return -1;
+	}
 
-#if ON_LOGGER
-	start = cv::getTickCount();
-#endif
+	begin_stage(STAGE_REFINE);
 	refine_camera(features, pairwise_matches, cameras);
-#if ON_LOGGER
-	printf("%lf\n",
-			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+	end_stage(STAGE_REFINE);
+	if (cancelled()) {
+		return -1;
+	}
+	if (!session_path.empty()) {
+		session.features = features;
+		session.pairwise_matches = pairwise_matches;
+	}
 	features.clear();
 	pairwise_matches.clear();
 	return retVal;
 }
 
 cv::Mat Stitcher::compositing(std::vector<cv::detail::CameraParams>& cameras) {
-#if ON_LOGGER
-	long long start;
-	printf("=========================================================\n");
-	printf("Compositing\n");
-#endif
+	LOG_INFO("=========================================================\n");
+	LOG_INFO("Compositing\n");
 	cv::Ptr<cv::WarperCreator> warper_creator;
 
 	// Warp images and their masks
-#if ON_LOGGER
-	start = cv::getTickCount();
-#endif
+	begin_stage(STAGE_WARPER);
 	create_warper(warper_creator);
-#if ON_LOGGER
-	printf("%lf\n",
-			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+	end_stage(STAGE_WARPER);
 
 	std::vector<cv::Point> corners(num_images);
 	std::vector<cv::Mat> masks_warped(num_images);
 	cv::Ptr<cv::detail::ExposureCompensator> compensator;
 	std::vector<cv::Size> sizes(num_images);
 
-#if ON_LOGGER
-	start = cv::getTickCount();
-#endif
+	loop.clear();
+	if (loop_aware()) {
+		loop.set_cameras(cameras);
+	}
+	begin_stage(STAGE_WARP);
 	std::vector<cv::Mat> images_warped_f = warp_img(corners, warper_creator,
 			sizes, masks_warped, cameras, compensator);
-#if ON_LOGGER
-	printf("%lf\n",
-			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+	end_stage(STAGE_WARP);
+
+	// Largest rectangle without black border, in seam estimation scale
+	cv::Rect seam_crop;
+	float seam_canvas_scale = warped_image_scale * seam_work_aspect;
+	if (crop_output && loop.closed()) {
+		seam_crop = valid_loop_rect(corners, masks_warped,
+				loop.width(seam_canvas_scale));
+	} else if (crop_output) {
+		seam_crop = valid_inner_rect(corners, masks_warped);
+	}
+
+	// Only overlaps of warped masks need pyramids, before seams cut them
+	std::vector<cv::Rect> overlaps;
+	if (blend_type == OverlapBlender::OVERLAP_MULTI_BAND && !cancelled()) {
+		overlaps = loop.closed() ?
+				loop_overlaps(corners, masks_warped) :
+				overlap_rects(corners, masks_warped);
+	}
 
 	// Prepare images masks
-#if ON_LOGGER
-	start = cv::getTickCount();
-#endif
-	find_seam(images_warped_f, corners, masks_warped);
-#if ON_LOGGER
-	printf("%lf\n",
-			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+	begin_stage(STAGE_SEAM);
+	if (!cancelled()) {
+		find_seam(images_warped_f, corners, masks_warped);
+	}
+	end_stage(STAGE_SEAM);
+	if (cancelled()) {
+		cv::Mat preview = preview_seams(images_warped_f, corners,
+				masks_warped);
+		images_warped_f.clear();
+		return preview;
+	}
 	images_warped_f.clear();
 
-#if ON_LOGGER
-	start = cv::getTickCount();
-#endif
+	begin_stage(STAGE_RESIZE_MASK);
 	double compose_scale = resize_mask(warper_creator, corners, sizes, cameras);
-#if ON_LOGGER
-	printf("%lf\n",
-			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+	end_stage(STAGE_RESIZE_MASK);
 
 	// Update corners and sizes
-#if ON_LOGGER
-	start = cv::getTickCount();
-#endif
-	cv::Ptr<cv::detail::Blender> blender = prepare_blender(corners, sizes);
-#if ON_LOGGER
-	printf("%lf\n",
-			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+	begin_stage(STAGE_PREPARE_BLEND);
+	cv::Rect canvas = cv::detail::resultRoi(corners, sizes);
+	if (loop.closed()) {
+		canvas = cv::Rect(0, canvas.y, loop.width(warped_image_scale),
+				canvas.height);
+	}
+	cv::Rect dst_roi = canvas;
+	if (crop_output) {
+		cv::Rect crop = scale_inner_rect(seam_crop,
+				warped_image_scale / seam_canvas_scale) & dst_roi;
+		// Every column of a loop is kept, only rows are cropped
+		if (loop.closed() && crop.height > 0) {
+			crop = cv::Rect(canvas.x, crop.y, canvas.width, crop.height);
+		}
+		if (crop.area() > 0) {
+			dst_roi = crop;
+		}
+		LOG_INFO("	Crop %dx%d of %dx%d\n", dst_roi.width, dst_roi.height,
+				canvas.width, canvas.height);
+	}
+	// A loop is blended past both edges and cut back to dst_roi
+	cv::Rect blend_roi = dst_roi;
+	if (loop.closed()) {
+		int margin = loop_margin(canvas.size());
+		blend_roi = cv::Rect(dst_roi.x - margin, dst_roi.y,
+				dst_roi.width + 2 * margin, dst_roi.height);
+	}
+	// Band workers render from the session, blending buffers are theirs
+	bool distributed = band_workers > 1;
+	if (!session_path.empty() || distributed) {
+		keep_session(compose_scale, canvas, dst_roi, cameras, masks_warped,
+				compensator);
+	}
+	cv::Ptr<cv::detail::Blender> blender;
+	if (!distributed) {
+		blender = prepare_blender(blend_roi, canvas.size());
+	}
+	end_stage(STAGE_PREPARE_BLEND);
 	cv::Mat result;
 
-#if ON_LOGGER
-	start = cv::getTickCount();
-#endif
-	blend_img(compose_scale, warper_creator, compensator, corners, masks_warped,
-			blender, cameras, result);
-#if ON_LOGGER
-	printf("%lf\n",
-			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+	begin_stage(STAGE_BLEND);
+	if (distributed && !cancelled()) {
+		result = composite_bands();
+	}
+	if (result.empty() && !cancelled()) {
+		if (blender.empty()) {
+			blender = prepare_blender(blend_roi, canvas.size());
+		}
+		set_overlaps(blender, overlaps, warped_image_scale / seam_canvas_scale);
+		blend_img(compose_scale, warper_creator, compensator, corners, sizes,
+				masks_warped, blend_roi, blender, cameras, result);
+		if (!result.empty() && blend_roi != dst_roi) {
+			result = result(cv::Rect(dst_roi.tl() - blend_roi.tl(),
+					dst_roi.size()));
+		}
+	}
+	end_stage(STAGE_BLEND);
 
 	corners.clear();
 	masks_warped.clear();
@@ -645,9 +1205,26 @@ cv::Mat Stitcher::compositing(std::vector<cv::detail::CameraParams>& cameras) {
 }
 
 Stitcher::Stitcher() {
-#if ON_LOGGER
-	printf("Create stitcher using no argument\n");
-#endif
+	LOG_INFO("Create stitcher using no argument\n");
+	cost_model = NULL;
+	metrics = NULL;
+	cancel_token = NULL;
+	retried = false;
+	tier = CostModel::STANDARD;
+	time_budget = 0;
+	use_plan = false;
+	crop_output = false;
+	prescreen_input = false;
+	predict_outcome = false;
+	hierarchical = false;
+	task_graph = false;
+	rotation_averaging = false;
+	band_workers = 0;
+	wrap_around = false;
+	all_components = false;
+	overlap_blend = false;
+	shared_threads = 0;
+	orientation = 1;
 	init(FAST);
 }
 
@@ -671,17 +1248,142 @@ void Stitcher::init(const Stitcher::InitMode& mode) {
 	confidence_threshold = 1.0;
 	seam_estimation_resol = 0.08;
 	compositing_resol = -1.0;
+	max_bands = 0;
+	if (use_plan) {
+		registration_resol = plan.registration_resol;
+		if (mode == NORMAL) {
+			registration_resol *= 2;
+		}
+		seam_estimation_resol = plan.seam_estimation_resol;
+		compositing_resol = plan.compositing_resol;
+		seam_find_type = static_cast<SeamFindType>(plan.seam_finder);
+		blend_type = plan.blender;
+		max_bands = plan.max_bands;
+	}
+	if (overlap_blend && blend_type == cv::detail::Blender::MULTI_BAND) {
+		blend_type = OverlapBlender::OVERLAP_MULTI_BAND;
+	}
 	matching_mask = cv::Mat(1, 1, CV_8U, cv::Scalar(0));
 	status = {OK, -1};
+	stage_time.assign(NUM_STAGES, 0);
+	stage_tick.assign(NUM_STAGES, 0);
+	stage_counters.assign(NUM_STAGES, PerfCounters::Values());
+	stage_counters_start.assign(NUM_STAGES, PerfCounters::Values());
+}
+
+void Stitcher::plan_job() {
+	CostModel default_model;
+	const CostModel& model = cost_model ? *cost_model : default_model;
+	plan = model.choose(job, tier, time_budget);
+	use_plan = true;
+	LOG_INFO("Plan: registration %.2f, seam %.2f, compositing %.2f, seam finder %d, blender %d\n",
+			plan.registration_resol, plan.seam_estimation_resol,
+			plan.compositing_resol, plan.seam_finder, plan.blender);
+	LOG_INFO("	Predicted time: %lf\n", model.predict(job, plan));
+	for (int i = 0; i < NUM_STAGES; i++) {
+		LOG_DETAIL("	%s: %lf\n", stage_name(PipelineStage(i)),
+				model.predict(PipelineStage(i), job, plan));
+	}
+}
+
+CostModel::Settings Stitcher::current_settings() {
+	CostModel::Settings settings;
+	settings.registration_resol = registration_resol;
+	settings.seam_estimation_resol = seam_estimation_resol;
+	settings.compositing_resol = compositing_resol;
+	settings.seam_finder = seam_find_type;
+	settings.blender = blend_type;
+	settings.max_bands = max_bands;
+	return settings;
+}
+
+void Stitcher::record_pass(bool calibrate) {
+	if (cost_model && calibrate) {
+		cost_model->observe(job, current_settings(), stage_time);
+	}
+	if (metrics) {
+		for (int i = 0; i < NUM_STAGES; i++) {
+			if (stage_time[i] > 0) {
+				metrics->observe("stitch_stage_seconds",
+						std::string("stage=\"") + stage_name(PipelineStage(i))
+								+ "\"", stage_time[i], seconds_buckets);
+			}
+		}
+	}
+	log_counters();
+	stage_time.assign(NUM_STAGES, 0);
+	stage_counters.assign(NUM_STAGES, PerfCounters::Values());
+	job.overlap_pairs = -1;
+}
+
+void Stitcher::begin_stage(PipelineStage stage) {
+	stage_tick[stage] = cv::getTickCount();
+	// Only stages looping over images count them
+	bool counted = stage == STAGE_FEATURES || stage == STAGE_WARP
+			|| stage == STAGE_BLEND;
+	status_channel.set_stage(stage, stage_name(stage), counted ? num_images : 0);
+	if (perf.is_open()) {
+		stage_counters_start[stage] = perf.read();
+	}
+}
+
+void Stitcher::end_stage(PipelineStage stage) {
+	double elapsed = (double(cv::getTickCount()) - stage_tick[stage])
+			/ cv::getTickFrequency();
+	stage_time[stage] += elapsed;
+	if (perf.is_open()) {
+		add_counters(stage, stage_counters_start[stage], perf.read(), 1);
+	}
+	LOG_INFO("%lf\n", elapsed);
+}
+
+void Stitcher::add_counters(PipelineStage stage,
+		const PerfCounters::Values& start, const PerfCounters::Values& end,
+		double share) {
+	PerfCounters::Values& counters = stage_counters[stage];
+	counters.resize(PerfCounters::NUM_EVENTS, -1);
+	for (int i = 0; i < PerfCounters::NUM_EVENTS; i++) {
+		if (start[i] >= 0 && end[i] >= 0) {
+			counters[i] = std::max(counters[i], 0.0)
+					+ (end[i] - start[i]) * share;
+		}
+	}
+}
+
+void Stitcher::log_counters() {
+	if (!perf.is_open()) {
+		return;
+	}
+	LOG_INFO("Counters:");
+	for (int i = 0; i < PerfCounters::NUM_EVENTS; i++) {
+		LOG_INFO(" %s", PerfCounters::event_name(PerfCounters::Event(i)));
+	}
+	LOG_INFO(" ipc llc_mpki\n");
+	for (int stage = 0; stage < NUM_STAGES; stage++) {
+		const PerfCounters::Values& counters = stage_counters[stage];
+		if (counters.empty()) {
+			continue;
+		}
+		LOG_INFO("	%s", stage_name(PipelineStage(stage)));
+		for (int i = 0; i < PerfCounters::NUM_EVENTS; i++) {
+			LOG_INFO(counters[i] >= 0 ? " %.0lf" : " -", counters[i]);
+		}
+		// Low IPC with many LLC misses per 1000 instructions: memory-bound
+		double cycles = counters[PerfCounters::CYCLES];
+		double instructions = counters[PerfCounters::INSTRUCTIONS];
+		double misses = counters[PerfCounters::LLC_MISSES];
+		LOG_INFO(cycles > 0 && instructions >= 0 ? " %.2lf" : " -",
+				instructions / cycles);
+		LOG_INFO(instructions > 0 && misses >= 0 ? " %.2lf\n" : " -\n",
+				misses * 1000 / instructions);
+	}
 }
 
 void Stitcher::set_matching_mask(const std::string& file_name,
 		std::vector<std::pair<int, int> >& edge_list) {
 	struct stat buf;
 	if (stat(file_name.c_str(), &buf) != -1) {
-#if ON_LOGGER
-		printf("	Input matching mask from file\n");
-#endif
+		LOG_INFO("	Input matching mask from file\n");
 		std::ifstream pairwise(file_name.c_str(), std::ifstream::in);
 		while (true) {
 			int i, j;
@@ -697,10 +1399,60 @@ void Stitcher::set_matching_mask(const std::string& file_name,
 	}
 }
 
-int Stitcher::rotate_img(const std::string& img_path) {
-#if ON_LOGGER
-	printf("	Rotate images if necessary: ");
-#endif
+//Apply Exif orientation to an image, oriented shares its pixels if there is none
+static void orient_img(const cv::Mat& image, cv::Mat& oriented,
+		int orientation) {
+	switch (orientation) {
+	case 8:
+		transpose(image, oriented);
+		flip(oriented, oriented, 0);
+		break;
+	case 6:
+		transpose(image, oriented);
+		flip(oriented, oriented, 1);
+		break;
+	case 3:
+		flip(image, oriented, -1);
+		break;
+	default:
+		oriented = image;
+		break;
+	}
+}
+
+cv::Mat Stitcher::view_img(int img_idx, double scale, int interpolation) {
+	cv::Size size(cvRound(input_size.width * scale),
+			cvRound(input_size.height * scale));
+	cv::Mat view = full_img[img_idx];
+	if (view.size() != size) {
+		cv::resize(full_img[img_idx], view, size, 0, 0, interpolation);
+	}
+	cv::Mat oriented;
+	orient_img(view, oriented, orientation);
+	return oriented;
+}
+
+cv::Mat Stitcher::warp_source(int img_idx, const cv::Size& size,
+		const cv::detail::CameraParams& camera,
+		cv::detail::CameraParams& source_camera) {
+	cv::Size raw_size = size;
+	if (orientation == 6 || orientation == 8) {
+		std::swap(raw_size.width, raw_size.height);
+	}
+	cv::Mat src = full_img[img_idx];
+	// Only images far from the size are resampled, the rest is warped as decoded
+	if (abs(double(raw_size.width) / src.cols - 1) > 1e-1
+			|| abs(double(raw_size.height) / src.rows - 1) > 1e-1) {
+		cv::Mat resized;
+		cv::resize(full_img[img_idx], mat_pool.attach(resized), raw_size);
+		src = resized;
+	}
+	source_camera = decoded_camera(camera, orientation, size, src.size());
+	return src;
+}
+
+int Stitcher::read_orientation(const std::string& img_path) {
+	LOG_INFO("	Rotate images if necessary: ");
 	try {
 		Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open(img_path);
 		assert(image.get() != 0);
@@ -716,59 +1468,29 @@ int Stitcher::rotate_img(const std::string& img_path) {
 		}
 		int angle = i->value().toLong();
 		switch (angle) {
-		case 8: {
-#if ON_LOGGER
-			printf("pi/4 radian CW");
-#endif
-#pragma omp parallel for
-			for (int i = 0; i < num_images; i++) {
-				transpose(full_img[i], full_img[i]);
-				flip(full_img[i], full_img[i], 0);
-			}
-		}
+		case 8:
+			LOG_INFO("pi/4 radian CW");
 			break;
-		case 6: {
-#if ON_LOGGER
-			printf("pi/4 radian CCW");
-#endif
-#pragma omp parallel for
-			for (int i = 0; i < num_images; i++) {
-				transpose(full_img[i], full_img[i]);
-				flip(full_img[i], full_img[i], 1);
-			}
-		}
+		case 6:
+			LOG_INFO("pi/4 radian CCW");
 			break;
-		case 3: {
-#if ON_LOGGER
-			printf("pi/2 radian CCW");
-#endif
-#pragma omp parallel for
-			for (int i = 0; i < num_images; i++) {
-				flip(full_img[i], full_img[i], -1);
-			}
+		case 3:
+			LOG_INFO("pi/2 radian CCW");
 			break;
-		}
 		case 1:
-#if ON_LOGGER
-			printf("no rotation.");
-#endif
+			LOG_INFO("no rotation.");
 			break;
 		}
+		return angle;
 	} catch (Exiv2::AnyError& e) {
-#if ON_LOGGER
-		printf(" %s\n", e.what());
-#endif
+		LOG_INFO(" %s\n", e.what());
 		return -1;
 	}
-	printf("\n");
-	return 0;
 }
 
 /*void Stitcher::feed(const std::string& dir)
  {
- #if ON_LOGGER
- printf("Scan directory to find input images and matching masks\n");
- #endif
+ LOG_INFO("Scan directory to find input images and matching masks\n");
  boost::filesystem::path dir_path(dir);
  std::string supported_format = ".jpg .jpeg .jpe .jp2 .png .bmp .dib .tif .tiff .pbm .pgm .ppm .sr .ras";
  try
@@ -847,23 +1569,18 @@ int Stitcher::rotate_img(const std::string& img_path) {
  }
  catch (const boost::filesystem::filesystem_error& ex)
  {
- #if ON_LOGGER
- printf("Error when processing files.\n");
- #endif
+ LOG_INFO("Error when processing files.\n");
  return;
  }
  }*/
 
-void Stitcher::feed(const std::string& input_dir) {
-	num_images = 0;
+void Stitcher::list_images(const std::string& input_dir,
+		std::vector<std::string>& img_name,
+		std::vector<std::pair<int, int>>& pairwise) {
 	struct stat buf;
 	std::string pairwise_path = input_dir + "pairwise.txt";
-	std::vector<std::string> img_name;
-	std::vector<std::pair<int, int>> pairwise;
 	if (stat(pairwise_path.c_str(), &buf) != -1) {
-#if ON_LOGGER
-		printf("Input from pairwise.txt\n");
-#endif
+		LOG_INFO("Input from pairwise.txt\n");
 		std::string src_img, dst_img;
 		std::ifstream ifs(pairwise_path, std::ifstream::in);
 		int src_idx = 0, dst_idx = 0;
@@ -893,16 +1610,12 @@ void Stitcher::feed(const std::string& input_dir) {
 			}
 			if (src_idx > dst_idx)
 				std::swap(src_idx, dst_idx);
-#if ON_LOGGER
-		printf("%d %d\n", src_idx, dst_idx);
-#endif
+		LOG_INFO("%d %d\n", src_idx, dst_idx);
 			pairwise.push_back(std::make_pair(src_idx, dst_idx));
 		}
 		ifs.close();
 	} else {
-#if ON_LOGGER
-		printf("Scan directory to find input images\n");
-#endif
+		LOG_INFO("Scan directory to find input images\n");
 		boost::filesystem::path dir_path(input_dir);
 		std::string supported_format =
 				".jpg .jpeg .jpe .jp2 .png .bmp .dib .tif .tiff .pbm .pgm .ppm .sr .ras";
@@ -919,7 +1632,6 @@ void Stitcher::feed(const std::string& input_dir) {
 						if (supported_format.find(extension)
 								!= std::string::npos) {
 							img_name.push_back(file_path.c_str());
-							num_images++;
 						}
 					}
 					it++;
@@ -927,38 +1639,99 @@ void Stitcher::feed(const std::string& input_dir) {
 				std::sort(img_name.begin(), img_name.end());
 			}
 		} catch (const boost::filesystem::filesystem_error& ex) {
-#if ON_LOGGER
-			printf("%s\n", ex.what());
-#endif
+			LOG_INFO("%s\n", ex.what());
+		}
+	}
+}
+
+void Stitcher::prescreen_images(std::vector<std::string>& img_name,
+		std::vector<std::pair<int, int>>& pairwise) {
+	LOG_INFO("Pre-screen images\n");
+	int n = img_name.size();
+	std::vector<Thumbnail> thumbs(n);
+#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		thumbs[i] = make_thumbnail(img_name[i]);
+	}
+	PrescreenResult screen = prescreen(thumbs, img_name);
+
+	// Renumber kept images, pairs of a duplicate go to its representative
+	std::vector<int> index(n, -1);
+	std::vector<std::string> kept;
+	thumbnails.clear();
+	for (int i = 0; i < n; i++) {
+		if (screen.representative[i] == i) {
+			index[i] = kept.size();
+			kept.push_back(img_name[i]);
+			thumbnails.push_back(thumbs[i].image);
+		}
+	}
+	std::set<std::pair<int, int> > pairs;
+	for (size_t i = 0; i < pairwise.size(); i++) {
+		int src = screen.representative[pairwise[i].first];
+		int dst = screen.representative[pairwise[i].second];
+		if (src >= 0 && dst >= 0 && src != dst) {
+			pairs.insert(std::make_pair(std::min(index[src], index[dst]),
+					std::max(index[src], index[dst])));
+		}
+	}
+	pairwise.assign(pairs.begin(), pairs.end());
+	img_name = kept;
+
+	for (size_t i = 0; i < screen.report.size(); i++) {
+		LOG_INFO("	%s\n", screen.report[i].c_str());
+	}
+	if (!result_dst.empty() && !screen.report.empty()) {
+		std::ofstream ofs((result_dst + "_prescreen.txt").c_str());
+		for (size_t i = 0; i < screen.report.size(); i++) {
+			ofs << screen.report[i] << "\n";
 		}
 	}
-	//Resize and rotate all images to a fixed sizes
+	if (metrics) {
+		metrics->inc("stitch_prescreen_dropped_total", "reason=\"duplicate\"",
+				screen.duplicates);
+		metrics->inc("stitch_prescreen_dropped_total", "reason=\"blurred\"",
+				screen.blurred);
+	}
+}
+
+void Stitcher::feed(const std::string& input_dir) {
+	std::vector<std::string> img_name;
+	std::vector<std::pair<int, int>> pairwise;
+	list_images(input_dir, img_name, pairwise);
+	thumbnails.clear();
+	if (prescreen_input && img_name.size() > 2) {
+		prescreen_images(img_name, pairwise);
+	}
 	num_images = img_name.size();
 	if (num_images < 2)
 		return;
-	full_img.resize(num_images);
+	full_img.assign(num_images, cv::Mat());
 	std::vector<cv::Size> full_img_tmp_size(num_images);
 #pragma omp parallel for
 	for (int i = 0; i < num_images; i++) {
-		full_img[i] = cv::imread(img_name[i]);
-		full_img_tmp_size[i] = full_img[i].size();
-	}
-	sort(full_img_tmp_size.begin(), full_img_tmp_size.end(), compareCvSize);
-	full_img_sizes = full_img_tmp_size[0];
-	if (compareCvSize(full_img_tmp_size[0],
-			full_img_tmp_size[num_images - 1])) {
-#pragma omp parallel for
-		for (int i = 0; i < num_images; i++) {
-			resize(full_img[i], full_img[i], full_img_sizes);
+		// The task graph decodes images in registration
+		if (task_graph) {
+			full_img_tmp_size[i] = read_image_size(img_name[i]);
+		} else {
+			full_img[i] = cv::imread(img_name[i]);
+			full_img_tmp_size[i] = full_img[i].size();
 		}
 	}
+	// Images keep their decoded pixels, the smallest size and the orientation
+	// of the 1st image are applied when they are downsampled or warped
+	sort(full_img_tmp_size.begin(), full_img_tmp_size.end(), compareCvSize);
+	input_size = full_img_tmp_size[0];
 	full_img_tmp_size.clear();
-	rotate_img(img_name[0]);
-	full_img_sizes = full_img[0].size();
-#if ON_LOGGER
-	printf("	Input sizes: %dx%d\n", full_img_sizes.height,
+	img_paths = img_name;
+	orientation = std::max(1, read_orientation(img_name[0]));
+	full_img_sizes = input_size;
+	if (orientation == 6 || orientation == 8) {
+		full_img_sizes = cv::Size(input_size.height, input_size.width);
+	}
+	LOG_INFO("\n");
+	LOG_INFO("	Input sizes: %dx%d\n", full_img_sizes.height,
 			full_img_sizes.width);
-#endif
 	//Set matching mask
 	if (!pairwise.empty()) {
 		matching_mask = cv::Mat(num_images, num_images, CV_8U, cv::Scalar(0));
@@ -978,30 +1751,1060 @@ std::string Stitcher::get_dst() {
 	return result_dst;
 }
 
+void Stitcher::set_cost_model(CostModel* model) {
+	cost_model = model;
+}
+
+void Stitcher::set_metrics(Metrics* job_metrics) {
+	metrics = job_metrics;
+}
+
+void Stitcher::set_session(const std::string& file_name) {
+	session_path = file_name;
+}
+
+void Stitcher::keep_session(double compose_scale, const cv::Rect& canvas,
+		const cv::Rect& dst_roi,
+		const std::vector<cv::detail::CameraParams>& cameras,
+		const std::vector<cv::Mat>& masks_warped,
+		const cv::Ptr<cv::detail::ExposureCompensator>& compensator) {
+	session.warp_type = warp_type;
+	session.blend_type = blend_type;
+	session.max_bands = max_bands;
+	session.orientation = orientation;
+	session.input_size = input_size;
+	session.full_img_sizes = full_img_sizes;
+	session.compose_scale = compose_scale;
+	session.warped_image_scale = warped_image_scale;
+	session.canvas = canvas;
+	session.dst_roi = dst_roi;
+	session.img_paths = img_paths;
+	session.cameras = cameras;
+	session.seam_masks = masks_warped;
+	session.work_scale = work_scale;
+	session.seam_work_aspect = seam_work_aspect;
+	session.gains.clear();
+	cv::detail::GainCompensator* gain =
+			dynamic_cast<cv::detail::GainCompensator*>(static_cast<cv::detail::ExposureCompensator*>(compensator));
+	if (gain) {
+		session.gains = gain->gains();
+	}
+}
+
+void Stitcher::write_session() {
+	if (session_path.empty() || session.cameras.empty()) {
+		return;
+	}
+	if (!session.save(session_path)) {
+		LOG_INFO("Can not save session to %s\n", session_path.c_str());
+	}
+}
+
+bool Stitcher::load_session(const std::string& file_name) {
+	if (!session.load(file_name)) {
+		return false;
+	}
+	num_images = session.img_paths.size();
+	full_img.assign(num_images, cv::Mat());
+	orientation = session.orientation;
+	input_size = session.input_size;
+	full_img_sizes = session.full_img_sizes;
+	return true;
+}
+
+cv::Mat Stitcher::load_img(int img_idx) {
+	return cv::imread(session.img_paths[img_idx]);
+}
+
+//Matches of dst to src from matches of src to dst, as FeaturesMatcher fills them
+static void store_dual(std::vector<cv::detail::MatchesInfo>& pairwise_matches,
+		int num_images, int src, int dst) {
+	cv::detail::MatchesInfo& info = pairwise_matches[src * num_images + dst];
+	info.src_img_idx = src;
+	info.dst_img_idx = dst;
+	cv::detail::MatchesInfo& dual = pairwise_matches[dst * num_images + src];
+	dual = info;
+	dual.src_img_idx = dst;
+	dual.dst_img_idx = src;
+	if (!info.H.empty()) {
+		dual.H = info.H.inv();
+	}
+	for (size_t k = 0; k < dual.matches.size(); k++) {
+		std::swap(dual.matches[k].queryIdx, dual.matches[k].trainIdx);
+	}
+}
+
+void Stitcher::register_graph(std::vector<cv::detail::ImageFeatures>& features,
+		std::vector<cv::detail::MatchesInfo>& pairwise_matches) {
+#if _OPENMP >= 201307
+	LOG_INFO("Decode, find features and match as a task graph\n");
+	// Progress counts images having their features, matching is not staged
+	status_channel.set_stage(STAGE_FEATURES, stage_name(STAGE_FEATURES),
+			num_images);
+	long long start = cv::getTickCount();
+	PerfCounters::Values counters_start;
+	if (perf.is_open()) {
+		counters_start = perf.read();
+	}
+	int n = num_images;
+	work_scale = std::min(1.0,
+			sqrt(registration_resol * 1e6 / full_img_sizes.area()));
+	double seam_scale = std::min(1.0,
+			sqrt(seam_estimation_resol * 1e6 / full_img_sizes.area()));
+	seam_work_aspect = seam_scale / work_scale;
+	cv::Ptr<cv::detail::FeaturesFinder> finder = create_finder();
+	cv::detail::BestOf2NearestMatcher matcher;
+	pairwise_matches.assign(n * n, cv::detail::MatchesInfo());
+	bool masked = matching_mask.rows == n && matching_mask.cols == n;
+	// Dependency tokens of images having their features
+	std::vector<char> tokens(n);
+	char* ready = &tokens[0];
+	double feature_seconds = 0, match_seconds = 0;
+
+#pragma omp parallel
+#pragma omp single
+	{
+		for (int i = 0; i < n; i++) {
+#pragma omp task firstprivate(i) depend(out: ready[i])
+			{
+				long long tick = cv::getTickCount();
+				if (full_img[i].empty() && !cancelled()) {
+					full_img[i] = cv::imread(img_paths[i]);
+				}
+				// Seam estimation image on a side branch
+#pragma omp task firstprivate(i)
+				if (!full_img[i].empty()) {
+					images[i] = view_img(i, seam_scale);
+				}
+				cv::Mat work;
+				if (!full_img[i].empty()) {
+					work = view_img(i, registration_resol > 0 ? work_scale : 1);
+				}
+				if (!work.empty()) {
+					(*finder)(work, features[i]);
+				}
+				features[i].img_idx = i;
+				ready[i] = 1;
+				status_channel.advance();
+				double seconds = (double(cv::getTickCount()) - tick)
+						/ cv::getTickFrequency();
+#pragma omp atomic
+				feature_seconds += seconds;
+			}
+		}
+		// Each pair starts as soon as both images have their features
+		for (int i = 0; i < n; i++) {
+			for (int j = i + 1; j < n; j++) {
+				if (masked && !matching_mask.at<uchar>(i, j)) {
+					continue;
+				}
+#pragma omp task firstprivate(i, j) depend(in: ready[i], ready[j])
+				{
+					long long tick = cv::getTickCount();
+					if (!features[i].keypoints.empty()
+							&& !features[j].keypoints.empty() && !cancelled()) {
+						matcher(features[i], features[j],
+								pairwise_matches[i * n + j]);
+						store_dual(pairwise_matches, n, i, j);
+					}
+					double seconds = (double(cv::getTickCount()) - tick)
+							/ cv::getTickFrequency();
+#pragma omp atomic
+					match_seconds += seconds;
+				}
+			}
+		}
+	}
+	finder->collectGarbage();
+	matcher.collectGarbage();
+
+	// Stages overlap, split wall time by their share of work
+	double elapsed = (double(cv::getTickCount()) - start)
+			/ cv::getTickFrequency();
+	double share = feature_seconds + match_seconds > 0 ?
+			feature_seconds / (feature_seconds + match_seconds) : 1;
+	stage_time[STAGE_FEATURES] += elapsed * share;
+	stage_time[STAGE_MATCHING] += elapsed * (1 - share);
+	if (perf.is_open()) {
+		PerfCounters::Values counters_end = perf.read();
+		add_counters(STAGE_FEATURES, counters_start, counters_end, share);
+		add_counters(STAGE_MATCHING, counters_start, counters_end, 1 - share);
+	}
+	LOG_INFO("%lf\n", elapsed);
+	if (metrics) {
+		for (int i = 0; i < n; ++i) {
+			metrics->observe("stitch_features_per_image", "",
+					features[i].keypoints.size(), feature_buckets);
+		}
+	}
+	count_pairs(pairwise_matches);
+#endif
+}
+
+cv::Mat Stitcher::render(const cv::Rect& rect, double scale) {
+	LOG_INFO("Render %dx%d at (%d, %d), scale %lf\n", rect.width, rect.height,
+			rect.x, rect.y, scale);
+	warp_type = static_cast<WarpType>(session.warp_type);
+	blend_type = session.blend_type;
+	max_bands = session.max_bands;
+	cv::Ptr<cv::WarperCreator> warper_creator;
+	create_warper(warper_creator);
+	float canvas_scale = session.warped_image_scale * scale;
+	double src_scale = session.compose_scale * scale;
+	cv::Size canvas_size(cvRound(session.canvas.width * scale),
+			cvRound(session.canvas.height * scale));
+	cv::Ptr<cv::detail::Blender> blender = prepare_blender(rect, canvas_size);
+	full_img.resize(num_images);
+
+#pragma omp parallel for
+	for (int img_idx = 0; img_idx < num_images; ++img_idx) {
+		cv::detail::CameraParams camera = session.cameras[img_idx];
+		camera.focal *= scale;
+		camera.ppx *= scale;
+		camera.ppy *= scale;
+		cv::Mat K;
+		camera.K().convertTo(K, CV_32F);
+		cv::Size sz = session.full_img_sizes;
+		if (abs(src_scale - 1) > 1e-1) {
+			sz.width = cvRound(sz.width * src_scale);
+			sz.height = cvRound(sz.height * src_scale);
+		}
+		// Skip images outside of the view before decoding them
+		cv::Ptr<cv::detail::RotationWarper> warper = warper_creator->create(
+				canvas_scale);
+		cv::Rect roi = warper->warpRoi(sz, K, camera.R);
+		if ((roi & rect).area() <= 0) {
+			continue;
+		}
+		if (full_img[img_idx].empty()) {
+			full_img[img_idx] = load_img(img_idx);
+		}
+		cv::detail::CameraParams source_camera;
+		cv::Mat src = warp_source(img_idx, sz, camera, source_camera);
+		cv::Mat source_K;
+		source_camera.K().convertTo(source_K, CV_32F);
+		cv::Mat img_warped, mask_warped;
+		mat_pool.attach(img_warped);
+		mat_pool.attach(mask_warped);
+		cv::Rect part = warp_part(warper, canvas_scale, src, source_K,
+				source_camera.R,
+				warper->warpRoi(src.size(), source_K, source_camera.R),
+				rect & roi, img_warped, mask_warped);
+		src.release();
+		if (!session.gains.empty()) {
+			img_warped *= session.gains[img_idx];
+		}
+		cv::Mat img_warped_s;
+		widen_to_16s(img_warped, mat_pool.attach(img_warped_s));
+		img_warped.release();
+		cv::Mat dilated_mask, seam_mask;
+		dilate(session.seam_masks[img_idx], dilated_mask, cv::Mat());
+		cv::resize(dilated_mask, mat_pool.attach(seam_mask), roi.size());
+		and_masks(seam_mask(part - roi.tl()), mask_warped, mask_warped);
+		seam_mask.release();
+#pragma omp critical
+		blender->feed(img_warped_s, mask_warped, part.tl());
+	}
+	cv::Mat result, result_mask;
+	blender->blend(result, result_mask);
+	result.convertTo(result, CV_8U);
+	return result;
+}
+
+bool Stitcher::prepare_stream(StreamStitcher& stream) {
+	if (session.cameras.size() != size_t(num_images)
+			|| session.seam_masks.size() != size_t(num_images)) {
+		return false;
+	}
+	warp_type = static_cast<WarpType>(session.warp_type);
+	blend_type = session.blend_type;
+	max_bands = session.max_bands;
+	cv::Ptr<cv::WarperCreator> warper_creator;
+	create_warper(warper_creator);
+	cv::Ptr<cv::detail::RotationWarper> warper = warper_creator->create(
+			session.warped_image_scale);
+	// Same blending as prepare_blender, pyramids only for multi-band types
+	int num_bands = 0;
+	float sharpness = 0;
+	float blend_width = canvas_blend_width(session.canvas.size());
+	if (blend_width >= 1.f) {
+		if (blend_type == cv::detail::Blender::MULTI_BAND
+				|| blend_type == OverlapBlender::OVERLAP_MULTI_BAND) {
+			num_bands = static_cast<int>(ceil(log(blend_width) / log(2.)) - 1.);
+			if (max_bands > 0) {
+				num_bands = std::min(num_bands, max_bands);
+			}
+		} else if (blend_type == cv::detail::Blender::FEATHER
+				|| blend_type == FastFeatherBlender::FAST_FEATHER) {
+			sharpness = 1.f / blend_width;
+		}
+	}
+	stream.prepare(session.dst_roi, num_bands, sharpness);
+
+	cv::Size sz = session.full_img_sizes;
+	if (abs(session.compose_scale - 1) > 1e-1) {
+		sz.width = cvRound(sz.width * session.compose_scale);
+		sz.height = cvRound(sz.height * session.compose_scale);
+	}
+	// Frames are warped as decoded, like warp_source
+	cv::Size raw_size = sz, source_size = session.input_size;
+	if (orientation == 6 || orientation == 8) {
+		std::swap(raw_size.width, raw_size.height);
+	}
+	if (abs(double(raw_size.width) / source_size.width - 1) > 1e-1
+			|| abs(double(raw_size.height) / source_size.height - 1) > 1e-1) {
+		source_size = raw_size;
+	}
+	for (int i = 0; i < num_images; i++) {
+		const cv::detail::CameraParams& camera = session.cameras[i];
+		cv::Mat K;
+		camera.K().convertTo(K, CV_32F);
+		cv::Rect seam_roi = warper->warpRoi(sz, K, camera.R);
+		cv::Mat dilated_mask, seam_mask;
+		dilate(session.seam_masks[i], dilated_mask, cv::Mat());
+		cv::resize(dilated_mask, seam_mask, seam_roi.size());
+		cv::detail::CameraParams source = decoded_camera(camera, orientation,
+				sz, source_size);
+		cv::Mat source_K;
+		source.K().convertTo(source_K, CV_32F);
+		stream.add_camera(warper, source_size, source_K, source.R, seam_mask,
+				seam_roi, session.gains.empty() ? 1 : session.gains[i]);
+	}
+	LOG_INFO("Stream of %d cameras, %d bands\n", num_images, num_bands);
+	return true;
+}
+
+bool Stitcher::stream_paths(const std::string& frame_dir,
+		std::vector<std::string>& paths) {
+	paths.clear();
+	if (session.img_paths.empty()) {
+		return false;
+	}
+	std::string calibration_dir = session.img_paths[0].substr(0,
+			session.img_paths[0].find_last_of('/') + 1);
+	std::vector<std::string> calibration, frames;
+	std::vector<std::pair<int, int> > pairwise;
+	list_images(calibration_dir, calibration, pairwise);
+	pairwise.clear();
+	list_images(frame_dir, frames, pairwise);
+	for (size_t i = 0; i < session.img_paths.size(); i++) {
+		size_t position = std::find(calibration.begin(), calibration.end(),
+				session.img_paths[i]) - calibration.begin();
+		if (position >= calibration.size() || position >= frames.size()) {
+			paths.clear();
+			return false;
+		}
+		paths.push_back(frames[position]);
+	}
+	return true;
+}
+
+int Stitcher::blend_margin(const cv::Size& canvas_size) {
+	if (blend_type == cv::detail::Blender::NO) {
+		return 0;
+	}
+	// Feather weights reach blend_width from seams, pyramids about twice that
+	float blend_width = canvas_blend_width(canvas_size);
+	return 2 * static_cast<int>(ceil(blend_width));
+}
+
+int Stitcher::blend_alignment(const cv::Size& canvas_size) {
+	float blend_width = canvas_blend_width(canvas_size);
+	if (blend_width < 1.f || (blend_type != cv::detail::Blender::MULTI_BAND
+			&& blend_type != OverlapBlender::OVERLAP_MULTI_BAND)) {
+		return 1;
+	}
+	// Same bands as prepare_blender, each halves the rows of the previous
+	int num_bands = static_cast<int>(ceil(log(blend_width) / log(2.)) - 1.);
+	if (max_bands > 0) {
+		num_bands = std::min(num_bands, max_bands);
+	}
+	return 1 << std::max(num_bands, 0);
+}
+
+cv::Mat Stitcher::composite_bands() {
+	std::string executable = self_executable();
+	std::string prefix = shared_dir + "stitch_"
+			+ std::to_string(static_cast<long long>(getpid()));
+	// The session of this pass, session_path only gets the one stitch() keeps
+	std::string session_file = prefix + ".yml", output_file = prefix + ".bgr";
+	if (!session.save(session_file)) {
+		return cv::Mat();
+	}
+	cv::Mat result;
+	std::vector<cv::Range> bands = split_bands(session.dst_roi.height,
+			band_workers);
+	SharedImage band_output;
+	if (!executable.empty()
+			&& band_output.create(output_file, session.dst_roi.size())) {
+		LOG_INFO("Composite %d bands in worker processes\n", int(bands.size()));
+		int threads = std::max(1, omp_get_num_procs() / int(bands.size()));
+		std::vector<std::vector<std::string> > commands;
+		for (size_t i = 0; i < bands.size(); i++) {
+			std::vector<std::string> command;
+			command.push_back(executable);
+			command.push_back("--band-worker");
+			command.push_back(session_file);
+			command.push_back(std::to_string(bands[i].start));
+			command.push_back(std::to_string(bands[i].end));
+			command.push_back(output_file);
+			command.push_back(std::to_string(threads));
+			commands.push_back(command);
+		}
+		int failed = run_processes(commands);
+		// A retry may keep the result of the 1st try, so it must own its pixels
+		if (failed == 0) {
+			result = band_output.mat().clone();
+		} else {
+			LOG_INFO("	%d band workers failed, blend in process\n", failed);
+		}
+		band_output.release();
+		unlink(output_file.c_str());
+	}
+	unlink(session_file.c_str());
+	return result;
+}
+
+bool Stitcher::render_band(const std::string& output_file, int begin,
+		int end) {
+	SharedImage output;
+	cv::Rect roi = session.dst_roi;
+	if (!output.open(output_file) || output.mat().size() != roi.size()
+			|| begin < 0 || end > roi.height || begin >= end) {
+		return false;
+	}
+	blend_type = session.blend_type;
+	max_bands = session.max_bands;
+	int margin = blend_margin(session.canvas.size());
+	int alignment = blend_alignment(session.canvas.size());
+	int top = std::max(0, begin - margin);
+	top -= top % alignment;
+	int bottom = std::min(roi.height, end + margin);
+	cv::Mat band = render(
+			cv::Rect(roi.x, roi.y + top, roi.width, bottom - top));
+	if (band.rows != bottom - top || band.cols != roi.width) {
+		return false;
+	}
+	band.rowRange(begin - top, end - top).copyTo(
+			output.mat().rowRange(begin, end));
+	return true;
+}
+
+std::vector<int> Stitcher::place_cameras(
+		const std::vector<cv::detail::ImageFeatures>& features,
+		const std::vector<cv::detail::MatchesInfo>& pairwise_matches,
+		std::vector<cv::detail::CameraParams>& cameras, int num_old) {
+	LOG_INFO("Place new cameras\n");
+	int n = features.size();
+	std::vector<bool> placed(n, false);
+	std::fill(placed.begin(), placed.begin() + num_old, true);
+	while (true) {
+		// Most confident pair of a placed camera and a new one
+		int from = -1, to = -1;
+		double confidence = confidence_threshold;
+		for (int i = 0; i < n; i++) {
+			for (int j = num_old; j < n && placed[i]; j++) {
+				const cv::detail::MatchesInfo& info = pairwise_matches[i * n + j];
+				if (!placed[j] && info.confidence > confidence
+						&& !info.H.empty()) {
+					confidence = info.confidence;
+					from = i;
+					to = j;
+				}
+			}
+		}
+		if (to < 0) {
+			break;
+		}
+		// Same as HomographyBasedEstimator along the edge from -> to
+		cameras[to].focal = cameras[from].focal;
+		cameras[to].aspect = cameras[from].aspect;
+		cameras[to].ppx = features[to].img_size.width * 0.5;
+		cameras[to].ppy = features[to].img_size.height * 0.5;
+		cv::Mat R_from;
+		cameras[from].R.convertTo(R_from, CV_64F);
+		cv::Mat R = R_from * cameras[from].K().inv()
+				* pairwise_matches[from * n + to].H.inv() * cameras[to].K();
+		// Closest rotation
+		cv::SVD svd(R);
+		R = svd.u * svd.vt;
+		if (cv::determinant(R) < 0) {
+			R *= -1;
+		}
+		R.convertTo(cameras[to].R, CV_32F);
+		placed[to] = true;
+		LOG_DETAIL("	%d from %d: %lf\n", to, from, confidence);
+	}
+	std::vector<int> indices;
+	for (int i = 0; i < n; i++) {
+		if (placed[i]) {
+			indices.push_back(i);
+		}
+	}
+	return indices;
+}
+
+void Stitcher::refine_local(
+		const std::vector<cv::detail::ImageFeatures>& features,
+		const std::vector<cv::detail::MatchesInfo>& pairwise_matches,
+		std::vector<cv::detail::CameraParams>& cameras, int num_old) {
+	LOG_INFO("Refine new cameras\n");
+	// New images and the old ones matched with them
+	int n = features.size();
+	std::vector<int> subset;
+	for (int i = 0; i < n; i++) {
+		bool near = i >= num_old;
+		for (int j = num_old; j < n && !near; j++) {
+			near = pairwise_matches[i * n + j].confidence > confidence_threshold;
+		}
+		if (near) {
+			subset.push_back(i);
+		}
+	}
+	int m = subset.size();
+	std::vector<cv::detail::ImageFeatures> sub_features(m);
+	std::vector<cv::detail::MatchesInfo> sub_matches(m * m);
+	std::vector<cv::detail::CameraParams> sub_cameras(m);
+	for (int k = 0; k < m; k++) {
+		sub_features[k] = features[subset[k]];
+		sub_features[k].img_idx = k;
+		sub_cameras[k] = cameras[subset[k]];
+		for (int l = 0; l < m; l++) {
+			cv::detail::MatchesInfo& info = sub_matches[k * m + l];
+			info = pairwise_matches[subset[k] * n + subset[l]];
+			info.src_img_idx = k;
+			info.dst_img_idx = l;
+		}
+	}
+	adjust_bundle(sub_features, sub_matches, sub_cameras);
+
+	// Rotation bringing refined old cameras back to their saved rotations
+	cv::Mat sum = cv::Mat::zeros(3, 3, CV_64F);
+	for (int k = 0; k < m; k++) {
+		if (isnan(sub_cameras[k].focal)) {
+			LOG_INFO("	Bundle adjustment diverged, keep initial cameras\n");
+			return;
+		}
+		if (subset[k] < num_old) {
+			cv::Mat R_saved, R_refined;
+			cameras[subset[k]].R.convertTo(R_saved, CV_64F);
+			sub_cameras[k].R.convertTo(R_refined, CV_64F);
+			sum += R_saved * R_refined.t();
+		}
+	}
+	cv::SVD svd(sum);
+	cv::Mat align = svd.u * svd.vt;
+	if (cv::determinant(align) < 0) {
+		return;
+	}
+	// Old cameras are kept, only new ones move
+	for (int k = 0; k < m; k++) {
+		if (subset[k] >= num_old) {
+			cv::Mat R_refined;
+			sub_cameras[k].R.convertTo(R_refined, CV_64F);
+			cv::detail::CameraParams& camera = cameras[subset[k]];
+			camera.focal = sub_cameras[k].focal;
+			camera.aspect = sub_cameras[k].aspect;
+			camera.ppx = sub_cameras[k].ppx;
+			camera.ppy = sub_cameras[k].ppy;
+			cv::Mat(align * R_refined).convertTo(camera.R, CV_32F);
+		}
+	}
+}
+
+void Stitcher::keep_images(const std::vector<int>& indices,
+		std::vector<cv::detail::ImageFeatures>& features,
+		std::vector<cv::detail::MatchesInfo>& pairwise_matches,
+		std::vector<cv::detail::CameraParams>& cameras) {
+	int n = features.size(), m = indices.size();
+	std::vector<cv::detail::ImageFeatures> features_subset(m);
+	std::vector<cv::detail::MatchesInfo> matches_subset(m * m);
+	std::vector<cv::detail::CameraParams> cameras_subset(m);
+	std::vector<cv::Mat> full_img_subset(m);
+	std::vector<std::string> img_paths_subset(m);
+	for (int k = 0; k < m; k++) {
+		features_subset[k] = features[indices[k]];
+		features_subset[k].img_idx = k;
+		cameras_subset[k] = cameras[indices[k]];
+		full_img_subset[k] = full_img[indices[k]];
+		img_paths_subset[k] = img_paths[indices[k]];
+		for (int l = 0; l < m; l++) {
+			cv::detail::MatchesInfo& info = matches_subset[k * m + l];
+			info = pairwise_matches[indices[k] * n + indices[l]];
+			info.src_img_idx = k;
+			info.dst_img_idx = l;
+		}
+	}
+	features = features_subset;
+	pairwise_matches = matches_subset;
+	cameras = cameras_subset;
+	full_img = full_img_subset;
+	img_paths = img_paths_subset;
+	session.img_paths = img_paths;
+	num_images = m;
+}
+
+void Stitcher::extend_seams(
+		const std::vector<cv::detail::CameraParams>& cameras, int num_old) {
+	LOG_INFO("Find seam of new images\n");
+	cv::Ptr<cv::WarperCreator> warper_creator;
+	create_warper(warper_creator);
+	double seam_scale = work_scale * seam_work_aspect;
+	double seam_compose_aspect = seam_scale / session.compose_scale;
+	cv::Ptr<cv::detail::RotationWarper> warper = warper_creator->create(
+			static_cast<float>(session.warped_image_scale * seam_compose_aspect));
+	cv::Size seam_size(cvRound(full_img_sizes.width * seam_scale),
+			cvRound(full_img_sizes.height * seam_scale));
+
+	// Images sharing the canvas with new ones, at seam estimation scale
+	int n = cameras.size();
+	std::vector<cv::Mat> K(n);
+	std::vector<cv::Rect> rois(n);
+	for (int i = 0; i < n; i++) {
+		cv::detail::CameraParams camera = cameras[i];
+		camera.focal *= seam_compose_aspect;
+		camera.ppx *= seam_compose_aspect;
+		camera.ppy *= seam_compose_aspect;
+		camera.K().convertTo(K[i], CV_32F);
+		rois[i] = warper->warpRoi(seam_size, K[i], camera.R);
+	}
+	std::vector<int> affected;
+	for (int i = 0; i < n; i++) {
+		bool touched = i >= num_old;
+		for (int j = num_old; j < n && !touched; j++) {
+			touched = (rois[i] & rois[j]).area() > 0;
+		}
+		if (touched) {
+			affected.push_back(i);
+		}
+	}
+
+	begin_stage(STAGE_WARP);
+	int m = affected.size();
+	std::vector<cv::Point> corners(m);
+	std::vector<cv::Mat> images_warped(m), images_warped_f(m), masks_warped(m),
+			seam_masks(m);
+#pragma omp parallel for
+	for (int k = 0; k < m; k++) {
+		int i = affected[k];
+		if (full_img[i].empty()) {
+			full_img[i] = load_img(i);
+		}
+		cv::Mat image = view_img(i, seam_scale);
+		float scale = static_cast<float>(session.warped_image_scale
+				* seam_compose_aspect);
+		cv::Ptr<cv::detail::RotationWarper> warper = warper_creator->create(
+				scale);
+		corners[k] = warp_part(warper, scale, image, K[i], cameras[i].R,
+				rois[i], rois[i], images_warped[k], masks_warped[k]).tl();
+		images_warped[k].convertTo(images_warped_f[k], CV_32F);
+		// Old images keep their seams against each other
+		if (i < num_old) {
+			cv::resize(session.seam_masks[i], seam_masks[k],
+					masks_warped[k].size(), 0, 0, cv::INTER_NEAREST);
+		} else {
+			seam_masks[k] = masks_warped[k].clone();
+		}
+	}
+
+	// Gains of new images relative to the saved gains of old ones
+	if (!session.gains.empty()) {
+		cv::detail::GainCompensator compensator;
+		cv::detail::ExposureCompensator& base = compensator;
+		base.feed(corners, images_warped, masks_warped);
+		std::vector<double> gains = compensator.gains();
+		std::vector<double> ratios;
+		for (int k = 0; k < m; k++) {
+			if (affected[k] < num_old && gains[k] > 0) {
+				ratios.push_back(session.gains[affected[k]] / gains[k]);
+			}
+		}
+		double ratio = 1;
+		if (!ratios.empty()) {
+			std::nth_element(ratios.begin(), ratios.begin() + ratios.size() / 2,
+					ratios.end());
+			ratio = ratios[ratios.size() / 2];
+		}
+		session.gains.resize(n, 1);
+		for (int k = 0; k < m; k++) {
+			if (affected[k] >= num_old) {
+				session.gains[affected[k]] = gains[k] * ratio;
+			}
+		}
+	}
+	images_warped.clear();
+	masks_warped.clear();
+	end_stage(STAGE_WARP);
+
+	begin_stage(STAGE_SEAM);
+	create_seam_finder()->find(images_warped_f, corners, seam_masks);
+	end_stage(STAGE_SEAM);
+	session.seam_masks.resize(n);
+	for (int k = 0; k < m; k++) {
+		session.seam_masks[affected[k]] = seam_masks[k];
+	}
+}
+
+bool Stitcher::extend(const std::string& input_dir) {
+	long long start = cv::getTickCount();
+	std::vector<std::string> img_name;
+	std::vector<std::pair<int, int>> pairwise;
+	list_images(input_dir, img_name, pairwise);
+	int num_old = session.img_paths.size();
+	std::vector<std::string> new_paths;
+	for (size_t i = 0; i < img_name.size(); i++) {
+		if (std::find(session.img_paths.begin(), session.img_paths.end(),
+				img_name[i]) == session.img_paths.end()) {
+			new_paths.push_back(img_name[i]);
+		}
+	}
+	// Sessions saved before features were kept can not be extended
+	if (num_old < 2 || session.features.size() != size_t(num_old)
+			|| session.pairwise_matches.size() != size_t(num_old * num_old)) {
+		return false;
+	}
+	// Nothing new, the previous output stands
+	if (new_paths.empty()) {
+		status = {OK, 1};
+		return true;
+	}
+	LOG_INFO("Extend %d images by %d\n", num_old, int(new_paths.size()));
+	status = {OK, -1};
+	warp_type = static_cast<WarpType>(session.warp_type);
+	blend_type = session.blend_type;
+	max_bands = session.max_bands;
+	orientation = session.orientation;
+	input_size = session.input_size;
+	full_img_sizes = session.full_img_sizes;
+	work_scale = session.work_scale;
+	seam_work_aspect = session.seam_work_aspect;
+	session.img_paths.insert(session.img_paths.end(), new_paths.begin(),
+			new_paths.end());
+	img_paths = session.img_paths;
+	int n = img_paths.size();
+	num_images = n;
+	full_img.assign(n, cv::Mat());
+	CostModel default_model;
+	job = (cost_model ? *cost_model : default_model).shape(n - num_old,
+			full_img_sizes.area() / 1e6,
+			(n - num_old) * (n + num_old - 1) / 2.0);
+
+	// Features of new images only
+	begin_stage(STAGE_FEATURES);
+	std::vector<cv::detail::ImageFeatures> features = session.features;
+	features.resize(n);
+	cv::Ptr<cv::detail::FeaturesFinder> finder = create_finder();
+#pragma omp parallel for
+	for (int i = num_old; i < n; i++) {
+		full_img[i] = load_img(i);
+		cv::Mat work = view_img(i, work_scale);
+		(*finder)(work, features[i]);
+		features[i].img_idx = i;
+	}
+	finder->collectGarbage();
+	end_stage(STAGE_FEATURES);
+
+	// Match new images with all others, old pairs are saved
+	begin_stage(STAGE_MATCHING);
+	matching_mask = cv::Mat::zeros(n, n, CV_8U);
+	for (int j = num_old; j < n; j++) {
+		for (int i = 0; i < j; i++) {
+			matching_mask.at<uchar>(i, j) = 1;
+		}
+	}
+	std::vector<cv::detail::MatchesInfo> pairwise_matches;
+	match_pairwise(features, pairwise_matches);
+	for (int i = 0; i < num_old; i++) {
+		for (int j = 0; j < num_old; j++) {
+			pairwise_matches[i * n + j] = session.pairwise_matches[i * num_old
+					+ j];
+		}
+	}
+	end_stage(STAGE_MATCHING);
+
+	// Cameras of old images at registration scale
+	begin_stage(STAGE_ESTIMATE);
+	double compose_work_aspect = session.compose_scale / work_scale;
+	std::vector<cv::detail::CameraParams> cameras(n);
+	for (int i = 0; i < num_old; i++) {
+		cameras[i] = session.cameras[i];
+		cameras[i].focal /= compose_work_aspect;
+		cameras[i].ppx /= compose_work_aspect;
+		cameras[i].ppy /= compose_work_aspect;
+	}
+	std::vector<int> indices = place_cameras(features, pairwise_matches,
+			cameras, num_old);
+	end_stage(STAGE_ESTIMATE);
+	status.second = double(indices.size()) / n;
+	if (int(indices.size()) == num_old) {
+		status.first = FAILED;
+		record_pass(false);
+		record_job(cv::Mat(), start);
+		return true;
+	}
+	if (int(indices.size()) < n) {
+		status.first = NOT_ENOUGH;
+		keep_images(indices, features, pairwise_matches, cameras);
+		n = num_images;
+	}
+
+	begin_stage(STAGE_REFINE);
+	refine_local(features, pairwise_matches, cameras, num_old);
+	end_stage(STAGE_REFINE);
+	for (int i = 0; i < n; i++) {
+		if (i < num_old) {
+			cameras[i] = session.cameras[i];
+		} else {
+			cameras[i].focal *= compose_work_aspect;
+			cameras[i].ppx *= compose_work_aspect;
+			cameras[i].ppy *= compose_work_aspect;
+		}
+	}
+
+	extend_seams(cameras, num_old);
+
+	// Canvas of all images at compositing
+	begin_stage(STAGE_RESIZE_MASK);
+	cv::Ptr<cv::WarperCreator> warper_creator;
+	create_warper(warper_creator);
+	cv::Ptr<cv::detail::RotationWarper> warper = warper_creator->create(
+			session.warped_image_scale);
+	cv::Size sz = full_img_sizes;
+	if (abs(session.compose_scale - 1) > 1e-1) {
+		sz.width = cvRound(sz.width * session.compose_scale);
+		sz.height = cvRound(sz.height * session.compose_scale);
+	}
+	std::vector<cv::Rect> rois(n);
+	std::vector<cv::Point> corners(n);
+	std::vector<cv::Size> sizes(n);
+	for (int i = 0; i < n; i++) {
+		cv::Mat K;
+		cameras[i].K().convertTo(K, CV_32F);
+		rois[i] = warper->warpRoi(sz, K, cameras[i].R);
+		corners[i] = rois[i].tl();
+		sizes[i] = rois[i].size();
+	}
+	cv::Rect canvas = cv::detail::resultRoi(corners, sizes);
+	end_stage(STAGE_RESIZE_MASK);
+
+	// Regions changed by new images, the rest is copied from previous output.
+	// The output keeps the previous crop, grown only by the new images
+	begin_stage(STAGE_PREPARE_BLEND);
+	cv::Rect previous_roi = session.dst_roi;
+	cv::Rect dst_roi = previous_roi;
+	for (int i = num_old; i < n; i++) {
+		dst_roi |= rois[i];
+	}
+	cv::Mat previous = cv::imread(result_dst + ".jpg");
+	float blend_width = canvas_blend_width(canvas.size());
+	int margin = cvCeil(blend_width);
+	if (blend_type == cv::detail::Blender::MULTI_BAND
+			|| blend_type == OverlapBlender::OVERLAP_MULTI_BAND) {
+		int num_bands = static_cast<int>(ceil(log(blend_width) / log(2.)) - 1.);
+		if (max_bands > 0) {
+			num_bands = std::min(num_bands, max_bands);
+		}
+		margin = 2 << std::max(num_bands, 0);
+	}
+	std::vector<cv::Rect> regions;
+	if (previous.size() != previous_roi.size()) {
+		regions.push_back(dst_roi);
+	} else {
+		for (int i = num_old; i < n; i++) {
+			regions.push_back(
+					cv::Rect(rois[i].x - margin, rois[i].y - margin,
+							rois[i].width + 2 * margin,
+							rois[i].height + 2 * margin) & dst_roi);
+		}
+		cv::Rect strips[] = { cv::Rect(dst_roi.x, dst_roi.y, dst_roi.width,
+				previous_roi.y - dst_roi.y), cv::Rect(dst_roi.x,
+				previous_roi.br().y, dst_roi.width,
+				dst_roi.br().y - previous_roi.br().y), cv::Rect(dst_roi.x,
+				previous_roi.y, previous_roi.x - dst_roi.x, previous_roi.height),
+				cv::Rect(previous_roi.br().x, previous_roi.y,
+						dst_roi.br().x - previous_roi.br().x,
+						previous_roi.height) };
+		for (int i = 0; i < 4; i++) {
+			if (strips[i].width > 0 && strips[i].height > 0) {
+				regions.push_back(strips[i]);
+			}
+		}
+		// Merge overlapping regions until none overlap, so no pixel is
+		// rendered twice; a merged region can reach ones already passed
+		bool merged = true;
+		while (merged) {
+			merged = false;
+			for (size_t i = 0; i < regions.size(); i++) {
+				for (size_t j = i + 1; j < regions.size(); j++) {
+					if ((regions[i] & regions[j]).area() > 0) {
+						regions[i] |= regions[j];
+						regions.erase(regions.begin() + j);
+						j = i;
+						merged = true;
+					}
+				}
+			}
+		}
+	}
+	cv::Mat result(dst_roi.size(), CV_8UC3, cv::Scalar::all(0));
+	if (previous.size() == previous_roi.size()) {
+		previous.copyTo(result(previous_roi - dst_roi.tl()));
+	}
+	previous.release();
+	end_stage(STAGE_PREPARE_BLEND);
+
+	session.cameras = cameras;
+	session.features = features;
+	session.pairwise_matches = pairwise_matches;
+	session.canvas = canvas;
+	session.dst_roi = dst_roi;
+	begin_stage(STAGE_BLEND);
+	for (size_t i = 0; i < regions.size(); i++) {
+		// Render with a margin so blending does not see the region's border
+		cv::Rect outer = cv::Rect(regions[i].x - margin, regions[i].y - margin,
+				regions[i].width + 2 * margin, regions[i].height + 2 * margin)
+				& canvas;
+		cv::Mat part = render(outer);
+		part(regions[i] - outer.tl()).copyTo(result(regions[i] - dst_roi.tl()));
+	}
+	end_stage(STAGE_BLEND);
+
+	write_result(result);
+	if (!session_path.empty() && !session.save(session_path)) {
+		LOG_INFO("Can not save session to %s\n", session_path.c_str());
+	}
+	record_pass(false);
+	if (metrics) {
+		metrics->inc("stitch_extensions_total");
+	}
+	record_job(result, start);
+	return true;
+}
+
+void Stitcher::set_prescreen(bool enable) {
+	prescreen_input = enable;
+}
+
+void Stitcher::set_prediction(bool enable) {
+	predict_outcome = enable;
+}
+
+void Stitcher::set_hierarchical(bool enable) {
+	hierarchical = enable;
+}
+
+void Stitcher::set_status_file(const std::string& path) {
+	if (!status_channel.open(path)) {
+		LOG_INFO("Can not publish status to %s\n", path.c_str());
+	}
+}
+
+void Stitcher::set_task_graph(bool enable) {
+#if _OPENMP >= 201307
+	task_graph = enable;
+#else
+	// Task dependencies need OpenMP 4.0, older compilers keep the staged path
+	task_graph = false;
+#endif
+}
+
+void Stitcher::set_rotation_averaging(bool enable) {
+	rotation_averaging = enable;
+}
+
+void Stitcher::set_wrap_around(bool enable) {
+	wrap_around = enable;
+}
+
+void Stitcher::set_all_components(bool enable) {
+	all_components = enable;
+}
+
+void Stitcher::set_perf_counters(bool enable) {
+	perf.close();
+	if (enable && !perf.open()) {
+		LOG_INFO("Performance counters are not available\n");
+	}
+}
+
+void Stitcher::set_cancel_token(CancelToken* token) {
+	cancel_token = token;
+}
+
+void Stitcher::set_band_workers(int workers) {
+	band_workers = workers;
+}
+
+void Stitcher::set_crop(bool enable) {
+	crop_output = enable;
+}
+
+void Stitcher::set_overlap_blend(bool enable) {
+	overlap_blend = enable;
+}
+
+void Stitcher::set_huge_pages(bool enable) {
+	mat_pool.set_huge_pages(enable);
+}
+
+void Stitcher::set_quality_tier(CostModel::Tier quality_tier, double budget) {
+	tier = quality_tier;
+	time_budget = budget;
+	use_plan = true;
+}
+
 void Stitcher::stitching_process(cv::Mat& result) {
+	if (status_channel.is_open()) {
+		// Progress of a pass follows predicted stage times
+		std::vector<double> weights(NUM_STAGES, 1);
+		if (cost_model) {
+			for (int i = 0; i < NUM_STAGES; i++) {
+				weights[i] = cost_model->predict(PipelineStage(i), job,
+						current_settings());
+			}
+		}
+		status_channel.set_weights(weights);
+	}
 	enum ReturnCode retVal = OK;
 	if (full_img.size() < 2) {
 		retVal = NEED_MORE;
 	} else {
 		cv::vector<cv::detail::CameraParams> cameras;
 		int check = registration(cameras);
-		if (check == -1) {
+		if (cancelled()) {
+			retVal = CANCELLED;
+		} else if (check == -1) {
 			retVal = FAILED;
 		} else {
 			if (check == 0) {
 				retVal = NOT_ENOUGH;
 			}
 			result = compositing(cameras);
-			if (result.rows * result.cols == 1) {
+			if (cancelled()) {
+				// Best effort: a preview or a partial blend
+				retVal = result.empty() ? CANCELLED : NOT_ENOUGH;
+			} else if (result.rows * result.cols == 1) {
 				retVal = FAILED;
 			}
 		}
 		cameras.clear();
 	}
+	join_parts();
 
 	status.first = retVal;
 }
 
+void Stitcher::finish_cancelled(const cv::Mat& result, double start) {
+	LOG_INFO("Cancelled: %s\n", get_status().c_str());
+	record_job(result, start);
+	// Free memory at once, the stitcher may live on until its caller returns
+	collect_garbage();
+	thumbnails.clear();
+	matching_mask.release();
+	session = Session();
+	mat_pool.release_cached();
+}
+
 void Stitcher::collect_garbage() {
 	full_img.clear();
 	img.clear();
@@ -1010,34 +2813,93 @@ void Stitcher::collect_garbage() {
 }
 
 void Stitcher::stitch() {
+	long long start = cv::getTickCount();
 	cv::Mat result;
 	std::vector<cv::Mat> img_bak = full_img;
-#if ON_LOGGER
-	printf("1st try\n");
-#endif
+	std::vector<std::string> paths_bak = img_paths;
+	double pairs = num_images * (num_images - 1) / 2.0;
+	if (matching_mask.rows * matching_mask.cols > 1) {
+		pairs = cv::countNonZero(matching_mask);
+	}
+	CostModel default_model;
+	job = (cost_model ? *cost_model : default_model).shape(num_images,
+			full_img_sizes.area() / 1e6, pairs);
+	InitMode first_mode = FAST;
+	bool allow_retry = true;
+	if (cancelled()) {
+		status = {CANCELLED, -1};
+		finish_cancelled(result, start);
+		return;
+	}
+	if (predict_outcome && num_images >= 2) {
+		const char* decision;
+		OverlapPrediction prediction = predict_job();
+		if (prediction.readable < 2) {
+			status = {NEED_MORE, -1};
+			decision = "need_more";
+		} else if (prediction.weak < 2) {
+			// Not even weak evidence of overlap, a full pass would fail too
+			status = {FAILED, 1.0 / num_images};
+			decision = "failed";
+		} else if (prediction.strong < prediction.weak) {
+			// Weak overlaps need the finer resolution of the 2nd try
+			first_mode = NORMAL;
+			allow_retry = false;
+			decision = "normal";
+		} else {
+			// Images without any overlap are left out by both tries
+			allow_retry = prediction.strong == num_images;
+			decision = allow_retry ? "fast" : "fast_only";
+		}
+		if (metrics) {
+			metrics->inc("stitch_predictions_total",
+					std::string("decision=\"") + decision + "\"");
+		}
+		if (status.first == NEED_MORE || status.first == FAILED) {
+			record_job(result, start);
+			return;
+		}
+	}
+	if ((use_plan || first_mode == NORMAL) && num_images >= 2) {
+		if (use_plan) {
+			plan_job();
+		}
+		cv::Mat mask = matching_mask;
+		init(first_mode);
+		matching_mask = mask;
+	}
+	job.overlap_pairs = -1;
+	LOG_INFO("1st try\n");
 	stitching_process(result);
+	// Truncated passes would teach the cost model wrong stage times
+	record_pass(!cancelled());
 	std::pair<ReturnCode, double> tmp_code = status;
-#if ON_LOGGER
-	printf("%d %lf\n\n", status.first, status.second);
-#endif
+	LOG_INFO("%d %lf\n\n", status.first, status.second);
 	if (status.first == NEED_MORE) {
+		record_job(result, start);
 		return;
 	}
-	if (status.first != OK) {
+	// Hierarchical registration already refined the images a retry would help.
+	// Once components are stitched as parts, images left out are only reported
+	if (status.first != OK && allow_retry && parts.empty() && !hierarchical
+			&& !cancelled()) {
 		cv::Mat retry;
+		// Restored if the result of the 1st try is kept
+		Session first_session = session;
+		retried = true;
+		status_channel.set_attempt(1);
 		collect_garbage();
 		init(NORMAL);
 		full_img = img_bak;
+		img_paths = paths_bak;
 		num_images = full_img.size();
-#if ON_LOGGER
-		printf("2nd try\n");
-#endif
+		LOG_INFO("2nd try\n");
 		stitching_process(retry);
-#if ON_LOGGER
-		printf("%d %lf\n", status.first, status.second);
-#endif
+		record_pass(!cancelled());
+		LOG_INFO("%d %lf\n", status.first, status.second);
 		switch (status.first) {
 		case NEED_MORE:
+			record_job(result, start);
 			return;
 		case OK:
 			result = retry.clone();
@@ -1048,43 +2910,116 @@ void Stitcher::stitch() {
 				result = retry.clone();
 			} else {
 				status = tmp_code;
+				session = first_session;
+				parts.clear();
 			}
 			break;
 		case FAILED:
+		case CANCELLED:
 			status = tmp_code;
+			session = first_session;
+			parts.clear();
 			break;
 		}
 	}
-#if ON_LOGGER
-	printf("Write final pano ");
-	long long start = cv::getTickCount();
-#endif
-#pragma omp parallel sections
-	{
-		{
-			std::string tmp_result = result_dst + ".jpg";
-			cv::imwrite(tmp_result, result);
+	if (cancelled()) {
+		img_bak.clear();
+		if (!result.empty()) {
+			write_result(result);
+			write_session();
 		}
-#pragma omp section
-		{
-			double scale = double(1080) / result.rows;
-			cv::Mat preview;
-			if (scale < 1.25f) {
-				cv::resize(result, preview, cv::Size(), scale, scale);
+		write_parts();
+		finish_cancelled(result, start);
+		return;
+	}
+	write_result(result);
+	write_session();
+	write_parts();
+	record_pass();
+	record_job(result, start);
+}
+
+OverlapPrediction Stitcher::predict_job() {
+	LOG_INFO("Predict overlap: ");
+	long long start = cv::getTickCount();
+	std::vector<cv::Mat> thumbs = thumbnails;
+	if (thumbs.size() != size_t(num_images)) {
+		thumbs.resize(num_images);
+		double scale = std::min(1.0,
+				sqrt(thumbnail_resol * 1e6 / full_img_sizes.area()));
+#pragma omp parallel for
+		for (int i = 0; i < num_images; i++) {
+			if (full_img[i].empty()) {
+				thumbs[i] = decode_thumbnail(img_paths[i]);
 			} else {
-				preview = result.clone();
+				thumbs[i] = view_img(i, scale, cv::INTER_AREA);
 			}
-			std::vector<int> compression_para;
-			compression_para.push_back(CV_IMWRITE_JPEG_QUALITY);
-			compression_para.push_back(75);
-			std::string tmp_preview = result_dst + "p.jpg";
-			cv::imwrite(tmp_preview, preview, compression_para);
 		}
 	}
-#if ON_LOGGER
-	printf("%lf\n",
+	OverlapPrediction prediction = predict_overlap(thumbs, matching_mask,
+			confidence_threshold);
+	LOG_INFO("%d readable, %d strong, %d weak of %d\n", prediction.readable,
+			prediction.strong, prediction.weak, prediction.num_images);
+	LOG_INFO("%lf\n",
 			(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+	return prediction;
+}
+
+void Stitcher::write_result(const cv::Mat& result) {
+	LOG_INFO("Write final pano ");
+	begin_stage(STAGE_WRITE);
+	// Strips of the pano are encoded by all threads, then the small preview
+	std::string tmp_result = result_dst + ".jpg";
+	if (!write_jpeg(tmp_result, result)) {
+		cv::imwrite(tmp_result, result);
+	}
+	double scale = double(1080) / result.rows;
+	cv::Mat preview;
+	if (scale < 1.25f) {
+		resize_bilinear(result, preview,
+				cv::Size(cvRound(result.cols * scale), cvRound(result.rows * scale)));
+	} else {
+		preview = result;
+	}
+	std::vector<int> compression_para;
+	compression_para.push_back(CV_IMWRITE_JPEG_QUALITY);
+	compression_para.push_back(75);
+	std::string tmp_preview = result_dst + "p.jpg";
+	cv::imwrite(tmp_preview, preview, compression_para);
+	end_stage(STAGE_WRITE);
+}
+
+void Stitcher::record_job(const cv::Mat& result, double start) {
+	status_channel.set_result(status.first, status.second, NUM_STAGES);
+	if (!metrics) {
+		return;
+	}
+	const char* names[] = { "ok", "not_enough", "failed", "need_more",
+			"cancelled" };
+	metrics->inc("stitch_jobs_total",
+			std::string("status=\"") + names[status.first] + "\"");
+	if (retried) {
+		metrics->inc("stitch_retries_total");
+	}
+	metrics->observe("stitch_job_seconds", "",
+			(double(cv::getTickCount()) - start) / cv::getTickFrequency(),
+			seconds_buckets);
+	metrics->observe("stitch_images", "", job.num_images, count_buckets);
+	if (status.second >= 0) {
+		metrics->observe("stitch_component_ratio", "", status.second,
+				ratio_buckets);
+	}
+	if (!result.empty()) {
+		metrics->observe("stitch_output_megapixels", "",
+				result.rows * double(result.cols) / 1e6, megapixel_buckets);
+	}
+	MatPool::Statistics pool = mat_pool.get_statistics();
+	metrics->inc("stitch_pool_allocations_total", "result=\"reused\"",
+			pool.reuses);
+	metrics->inc("stitch_pool_allocations_total", "result=\"new\"",
+			pool.allocations - pool.reuses);
+	metrics->observe("stitch_pool_high_water_megabytes", "",
+			pool.high_water / 1e6, megapixel_buckets);
 }
 
 std::string Stitcher::get_status() {
@@ -1100,10 +3035,15 @@ std::string Stitcher::get_status() {
 		return "Failed";
 	case NEED_MORE:
 		return "Need more images";
+	case CANCELLED:
+		return "Cancelled";
 	}
 	return ostr.str();
 }
 
 Stitcher::~Stitcher() {
-
+	join_parts();
+	MatPool::Statistics pool = mat_pool.get_statistics();
+	LOG_INFO("Buffer pool: %lu allocations, %lu reused, high water %lu MB\n",
+			pool.allocations, pool.reuses, pool.high_water >> 20);
 }
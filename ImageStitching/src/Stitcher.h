@@ -10,6 +10,8 @@
 
 #include <bits/stdc++.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
 
 #include <exiv2/exiv2.hpp>
 #include <boost/filesystem/operations.hpp>
@@ -30,14 +32,35 @@
 #include <opencv2/stitching/detail/warpers.hpp>
 #include <opencv2/stitching/warpers.hpp>
 
-#define ON_LOGGER true
-#define ON_DETAIL false
+#include "Bands.h"
+#include "Cancellation.h"
+#include "Canvas.h"
+#include "CanvasLoop.h"
+#include "CostModel.h"
+#include "FastFeatherBlender.h"
+#include "JpegWriter.h"
+#include "Logger.h"
+#include "MatPool.h"
+#include "OverlapBlender.h"
+#include "PerfCounters.h"
+#include "PixelKernels.h"
+#include "Metrics.h"
+#include "PipelineStage.h"
+#include "Predictor.h"
+#include "Prescreen.h"
+#include "RotationAveraging.h"
+#include "Session.h"
+#include "StatusChannel.h"
+#include "StreamStitcher.h"
+#include "WarpKernels.h"
 
 int compareCvSize(const cv::Size&, const cv::Size&);
 
 class Stitcher {
 
 private:
+	//Buffers of warping and blending, declared first to outlive every Mat of the stitcher
+	MatPool mat_pool;
 	/*
 	 * Registration resolution: parameter for resizing images to find features
 	 * Seam estimation resolution*: parameter for seam estimation
@@ -48,19 +71,23 @@ private:
 			confidence_threshold;
 	/*
 	 * expos_comp_type: enum contains type of Exposure Compensator
-	 * blend_type: type of blender
+	 * blend_type: type of blender, cv::detail::Blender's, FastFeatherBlender::FAST_FEATHER
+	 * or OverlapBlender::OVERLAP_MULTI_BAND
 	 */
 	int expos_comp_type, blend_type;
 	int num_images; //number of input images
 	double seam_work_aspect; //for warping images
 	double work_scale; //finding features and blending
 	float warped_image_scale; //blending
-	std::vector<cv::Mat> full_img; //original images
+	std::vector<cv::Mat> full_img; //decoded images, before resizing and Exif orientation
 	std::vector<cv::Mat> img; //temporary images used for finding features and blending
 	std::vector<cv::Mat> images; //temporary images used for warping
 	cv::Size full_img_sizes; //sizes of original images
+	cv::Size input_size; //sizes of original images before Exif orientation
+	int orientation; //Exif orientation applied to original images
+	std::vector<std::string> img_paths; //files of original images
 	enum ReturnCode {
-		OK, NOT_ENOUGH, FAILED, NEED_MORE
+		OK, NOT_ENOUGH, FAILED, NEED_MORE, CANCELLED
 	};
 	std::pair<ReturnCode, double> status; // status of stitching process: failed, success or not enough
 	std::string result_dst; ////determine the input and output directory
@@ -87,18 +114,97 @@ private:
 		NO, VORONOI, GC_COLOR, GC_COLORGRAD, DP_COLOR, DP_COLORGRAD
 	};
 	enum SeamFindType seam_find_type;
+	int max_bands; //upper bound of multi-band blender's bands, 0 for no bound
+	bool crop_output; //only compose the largest rectangle without black border
+	bool prescreen_input; //drop near-duplicate and blurred images in feed
+	std::vector<cv::Mat> thumbnails; //small decodes of input images, kept by pre-screening
+	bool predict_outcome; //predict the outcome from thumbnails before registration
+	bool hierarchical; //re-match images left out of the biggest component at finer resolution
+	bool task_graph; //decode, find features and match images as a graph of OpenMP tasks
+	bool rotation_averaging; //estimate cameras by averaging rotations of all pairs
+	int band_workers; //processes compositing bands of the output, 0 or 1 to blend in process
+	bool wrap_around; //close cylindrical and spherical panoramas covering 360 degrees into a loop
+	bool all_components; //stitch every component of 2 or more images as its own panorama
+	bool overlap_blend; //blend through pyramids of overlaps only, in place of multi-band
+	/*
+	 * Components beside the biggest, each stitched by a part in its own thread
+	 * part_result: panorama of a part
+	 * shared_threads: OpenMP threads of this stitcher before parts took their share
+	 */
+	std::vector<cv::Ptr<Stitcher> > parts;
+	std::vector<std::thread> part_threads;
+	cv::Mat part_result;
+	int shared_threads;
+	CanvasLoop loop; //placement of images of the current compositing, empty if linear
+
+	/*
+	 * Latency planning
+	 * cost_model: calibrated by every pass, not owned
+	 * tier, time_budget: choose settings of the job when use_plan is set
+	 * job: shape of the job, overlap_pairs is measured by pairwise matching
+	 */
+	CostModel* cost_model;
+	CostModel::Tier tier;
+	double time_budget;
+	bool use_plan;
+	CostModel::Settings plan;
+	CostModel::JobShape job;
+	std::vector<double> stage_time; //seconds spent in each stage of current pass
+	std::string session_path; //save registration state here when not empty
+	Session session; //registration state of the last compositing, of the kept pass once stitched, or loaded
+	std::vector<long long> stage_tick; //start tick of running stages
+	PerfCounters perf; //open when hardware counters are sampled per stage
+	StatusChannel status_channel; //progress for pollers, open when a status file is set
+	std::vector<PerfCounters::Values> stage_counters; //counts of each stage in current pass
+	std::vector<PerfCounters::Values> stage_counters_start; //counts at start of running stages
+	Metrics* metrics; //aggregated job metrics, not owned
+	CancelToken* cancel_token; //checked by every stage, not owned
+	bool retried; //the job needed the 2nd try
 
 	//Stitcher class's initialization with argument
 	enum InitMode {
 		FAST, NORMAL
 	};
 	void init(const InitMode&);
+
+	//Choose settings of the job from the cost model
+	void plan_job();
+	//Settings used by current pass
+	CostModel::Settings current_settings();
+	//Record measured stage times of current pass, feeding the cost model if calibrate
+	void record_pass(bool = true);
+	//Measure time of a stage
+	void begin_stage(PipelineStage);
+	void end_stage(PipelineStage);
+	//Add a share of the counts between 2 reads to a stage
+	void add_counters(PipelineStage, const PerfCounters::Values&,
+			const PerfCounters::Values&, double);
+	//Write counts of every stage of current pass to the log
+	void log_counters();
 	//Input matching mask from file
 	void set_matching_mask(const std::string&,
 			std::vector<std::pair<int, int> >&) __attribute__ ((deprecated));;
 
-	//Rotate images for better stitching
-	int rotate_img(const std::string&);
+	//Exif orientation of an image, -1 if not found
+	int read_orientation(const std::string&);
+
+	//Image as the pipeline sees it at a scale: downsampled from decoded pixels, then oriented
+	cv::Mat view_img(int, double, int = cv::INTER_LINEAR);
+
+	//Decoded pixels of an image to warp at an oriented size, and the camera seeing them
+	cv::Mat warp_source(int, const cv::Size&, const cv::detail::CameraParams&,
+			cv::detail::CameraParams&);
+
+	//List input images and pairs to match of a directory
+	void list_images(const std::string&, std::vector<std::string>&,
+			std::vector<std::pair<int, int> >&);
+
+	//Features finder for images at registration resolution
+	cv::Ptr<cv::detail::FeaturesFinder> create_finder();
+
+	//Collapse near-duplicates and drop blurred images, remapping pairs to match
+	void prescreen_images(std::vector<std::string>&,
+			std::vector<std::pair<int, int> >&);
 
 	//Find image's features for matching
 	void find_features(std::vector<cv::detail::ImageFeatures>&);
@@ -107,32 +213,90 @@ private:
 	void match_pairwise(std::vector<cv::detail::ImageFeatures>&,
 			std::vector<cv::detail::MatchesInfo>&);
 
+	//Find features of images outside the biggest component at finer resolution
+	//and match again the pairs having one of them
+	void rematch_weak(std::vector<cv::detail::ImageFeatures>&,
+			std::vector<cv::detail::MatchesInfo>&);
+
+	//Count overlapping pairs and record their inliers
+	void count_pairs(const std::vector<cv::detail::MatchesInfo>&);
+
+	//Decode, find features and match without stage barriers: features of an
+	//image follow its decoding, a pair is matched once both have features.
+	//Needs OpenMP 4.0 task dependencies, without them it does nothing
+	void register_graph(std::vector<cv::detail::ImageFeatures>&,
+			std::vector<cv::detail::MatchesInfo>&);
+
 	//Extract biggest component from pairwise matching
 	void extract_biggest_component(std::vector<cv::detail::ImageFeatures>&,
 			std::vector<cv::detail::MatchesInfo>&);
 
+	/*
+	 * Stitching every component
+	 * find_components: components of 2 or more images, biggest first
+	 * split_components: keep the biggest, start a part for each other one
+	 * stitch_part: estimate cameras and composite a part with some OpenMP threads
+	 * join_parts: wait for parts, giving back their threads
+	 * write_parts: write panoramas of parts and list status of every component
+	 */
+	std::vector<std::vector<int> > find_components(
+			const std::vector<cv::detail::MatchesInfo>&);
+	void split_components(std::vector<cv::detail::ImageFeatures>&,
+			std::vector<cv::detail::MatchesInfo>&);
+	void stitch_part(std::vector<cv::detail::ImageFeatures>,
+			std::vector<cv::detail::MatchesInfo>, int);
+	void join_parts();
+	void write_parts();
+
 	//Estimate camera
 	void estimate_camera(std::vector<cv::detail::ImageFeatures>&,
 			std::vector<cv::detail::MatchesInfo>&,
 			std::vector<cv::detail::CameraParams>&);
 
+	//Run bundle adjustment on cameras
+	void adjust_bundle(const std::vector<cv::detail::ImageFeatures>&,
+			const std::vector<cv::detail::MatchesInfo>&,
+			std::vector<cv::detail::CameraParams>&);
+
 	//Refine
 	void refine_camera(const std::vector<cv::detail::ImageFeatures>&,
 			const std::vector<cv::detail::MatchesInfo>&,
 			std::vector<cv::detail::CameraParams>&);
 
+	//The job's cancel token expired
+	bool cancelled();
+
+	//Warped images at seam estimation resolution put together, output of a
+	//job cancelled before blending. Empty if none was warped
+	cv::Mat preview_seams(const std::vector<cv::Mat>&,
+			const std::vector<cv::Point>&, const std::vector<cv::Mat>&);
+
 	//First stage of stitching, do needed calculation for stitching
 	int registration(std::vector<cv::detail::CameraParams>&);
 
+	//Place images by a CanvasLoop: wrap_around with a cylindrical or spherical warp,
+	//blended in process without a session
+	bool loop_aware() const;
+
 	//Create warper that effect the "style" of output
 	void create_warper(cv::Ptr<cv::WarperCreator>&);
 
+	//Warp the part of an image inside a region of the canvas, by the kernel of
+	//warp_type if it has one. scale: scale of the warper, then the image's
+	//warpRoi computed once by the caller, and the region
+	cv::Rect warp_part(const cv::Ptr<cv::detail::RotationWarper>&, float,
+			const cv::Mat&, const cv::Mat&, const cv::Mat&, const cv::Rect&,
+			const cv::Rect&, cv::Mat&, cv::Mat&);
+
 	//Warp all remain images from pairwise matching
 	std::vector<cv::Mat> warp_img(std::vector<cv::Point>&,
 			const cv::Ptr<cv::WarperCreator>&, std::vector<cv::Size>&,
 			std::vector<cv::Mat>&, std::vector<cv::detail::CameraParams>&,
 			cv::Ptr<cv::detail::ExposureCompensator>&);
 
+	//Create seam finder of seam_find_type
+	cv::Ptr<cv::detail::SeamFinder> create_seam_finder();
+
 	//Find seam for stitching and blending
 	void find_seam(std::vector<cv::Mat>&, const std::vector<cv::Point>&,
 			std::vector<cv::Mat>&);
@@ -142,24 +306,83 @@ private:
 			std::vector<cv::Point>&, std::vector<cv::Size>&,
 			std::vector<cv::detail::CameraParams>&);
 
-	//Prepare blend
-	cv::Ptr<cv::detail::Blender> prepare_blender(const std::vector<cv::Point>&,
-			const std::vector<cv::Size>&);
+	//Overlaps of a closed loop at seam estimation resolution, also across the wrap
+	std::vector<cv::Rect> loop_overlaps(const std::vector<cv::Point>&,
+			const std::vector<cv::Mat>&);
+
+	//Prepare blend for the output region of a canvas of given size
+	cv::Ptr<cv::detail::Blender> prepare_blender(const cv::Rect&,
+			const cv::Size&);
+
+	//Restrict an OverlapBlender to overlaps found at seam estimation resolution
+	void set_overlaps(const cv::Ptr<cv::detail::Blender>&,
+			const std::vector<cv::Rect>&, double);
 
-	//Stitch and blend output pano
+	//Stitch and blend the output region of pano
 	void blend_img(const double&, const cv::Ptr<cv::WarperCreator>&,
 			cv::Ptr<cv::detail::ExposureCompensator>&, std::vector<cv::Point>&,
-			std::vector<cv::Mat>&, cv::Ptr<cv::detail::Blender>&,
+			const std::vector<cv::Size>&, std::vector<cv::Mat>&,
+			const cv::Rect&, cv::Ptr<cv::detail::Blender>&,
 			std::vector<cv::detail::CameraParams>&, cv::Mat&);
 
 	//Final stage of stitching, do all work basing on first stage output
 	cv::Mat compositing(std::vector<cv::detail::CameraParams>&);
 
+	//Keep registration state of compositing in session, stitch() writes the
+	//one of the pass it keeps
+	void keep_session(double, const cv::Rect&, const cv::Rect&,
+			const std::vector<cv::detail::CameraParams>&,
+			const std::vector<cv::Mat>&,
+			const cv::Ptr<cv::detail::ExposureCompensator>&);
+	//Write session to session_path if both are set
+	void write_session();
+	//Read an original image of the session
+	cv::Mat load_img(int);
+	//Rows a band must overlap its neighbors to blend like the whole canvas
+	int blend_margin(const cv::Size&);
+	//Rows from the output's top a band's rendering must start at a multiple of,
+	//so multi-band pyramids sample the same rows as for the whole canvas
+	int blend_alignment(const cv::Size&);
+	//Render the session's output by band workers, empty if they fail
+	cv::Mat composite_bands();
+
+	/*
+	 * Incremental stitching, images before the given count are the session's
+	 * place_cameras: chain new cameras to placed ones, return indices of placed images
+	 * refine_local: bundle adjust new images and their neighbors, keeping old cameras
+	 * keep_images: leave only images of given indices
+	 * extend_seams: seam masks and gains of new images, updating touched old seams
+	 */
+	std::vector<int> place_cameras(
+			const std::vector<cv::detail::ImageFeatures>&,
+			const std::vector<cv::detail::MatchesInfo>&,
+			std::vector<cv::detail::CameraParams>&, int);
+	void refine_local(const std::vector<cv::detail::ImageFeatures>&,
+			const std::vector<cv::detail::MatchesInfo>&,
+			std::vector<cv::detail::CameraParams>&, int);
+	void keep_images(const std::vector<int>&,
+			std::vector<cv::detail::ImageFeatures>&,
+			std::vector<cv::detail::MatchesInfo>&,
+			std::vector<cv::detail::CameraParams>&);
+	void extend_seams(const std::vector<cv::detail::CameraParams>&, int);
+
+	//Match thumbnails to predict the outcome of registration
+	OverlapPrediction predict_job();
+
+	//Write panorama and its preview to result_dst
+	void write_result(const cv::Mat&);
+
 	//The whole process combing first and second stage
 	void stitching_process(cv::Mat&);
 
 	void collect_garbage();
 
+	//Record a cancelled job and free its memory
+	void finish_cancelled(const cv::Mat&, double);
+
+	//Record metrics of the finished job
+	void record_job(const cv::Mat&, double);
+
 public:
 
 	//Stitcher class's constructor with no argument
@@ -169,6 +392,63 @@ public:
 	void set_dst(const std::string&);
 	//Get output directory's name
 	std::string get_dst();
+	//Set cost model used for planning and calibration
+	void set_cost_model(CostModel*);
+	//Choose resolutions and algorithms by tier and time budget in seconds (<= 0 for tier's default)
+	void set_quality_tier(CostModel::Tier, double = 0);
+	//Set metrics recording this stitcher's jobs
+	void set_metrics(Metrics*);
+	//Save registration state to this file after compositing
+	void set_session(const std::string&);
+	//Restore registration state saved by a previous stitch
+	bool load_session(const std::string&);
+	//Render a region of the session's canvas scaled by a factor of compositing scale
+	cv::Mat render(const cv::Rect&, double = 1.0);
+	//Render rows [begin, end) of the session's output into a SharedImage file,
+	//entry of a band worker process
+	bool render_band(const std::string&, int, int);
+	//Calibrate a stream of frame sets from the session's cameras, seams and gains
+	bool prepare_stream(StreamStitcher&);
+	//Images of a frame set directory matching the session's images by their
+	//position among images of their directory. Return false if some are missing
+	bool stream_paths(const std::string&, std::vector<std::string>&);
+	//Add new images of a directory to the session's panorama, recompositing only
+	//regions they touch; without new images the output is left as is. Return
+	//false if the session can not be extended
+	bool extend(const std::string&);
+	//Drop near-duplicate and blurred images in feed, writing a report next to the output
+	void set_prescreen(bool);
+	//Predict the outcome before registration: stop doomed jobs, start at the
+	//resolution the job needs and skip retries that can not help
+	void set_prediction(bool);
+	//Refine only images left out by registration instead of retrying all at finer resolution
+	void set_hierarchical(bool);
+	//Defer decoding to registration and run it as a task graph, ignored
+	//below OpenMP 4.0 (_OPENMP 201307)
+	void set_task_graph(bool);
+	//Publish stage, images done, progress and result of the job in a mmap-ed file
+	void set_status_file(const std::string&);
+	//Start bundle adjustment from rotations averaged over all pairs and a consensus focal
+	void set_rotation_averaging(bool);
+	//Compose a cylindrical or spherical panorama covering 360 degrees as a seamless loop
+	void set_wrap_around(bool);
+	//Stitch every component of 2 or more images concurrently, each as its own
+	//panorama <dst>_<k>.jpg listed in <dst>.components; a job split this way is not retried.
+	//Parts save their session as <dst>_<k>.yml.gz and use huge pages like this
+	//stitcher, but composite in their own thread share without band workers
+	void set_all_components(bool);
+	//Sample cycles, instructions, LLC misses, page faults and context switches per stage
+	void set_perf_counters(bool);
+	//Stop at the next check once this token expires, returning what is done
+	void set_cancel_token(CancelToken*);
+	//Composite the output in this many worker processes
+	void set_band_workers(int);
+	//Only compose the largest rectangle without black border
+	void set_crop(bool);
+	//Multi-band blend only overlaps of images through an OverlapBlender
+	void set_overlap_blend(bool);
+	//Back large buffers by transparent huge pages
+	void set_huge_pages(bool);
 	//Input images and do some pre-calculation
 	void feed(const std::string&);
 
@@ -0,0 +1,268 @@
+/*
+ * StreamStitcher.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#include "StreamStitcher.h"
+
+//Same guard against empty weights as cv::detail::MultiBandBlender
+static const float weight_eps = 1e-5f;
+
+StreamStitcher::StreamStitcher(size_t depth) :
+		composited(0), inputs(depth), decoded(depth), composed(depth), outputs(0) {
+	num_bands = 0;
+	sharpness = 0;
+}
+
+StreamStitcher::~StreamStitcher() {
+	close();
+}
+
+void StreamStitcher::prepare(const cv::Rect& roi, int bands, float sharp) {
+	dst_roi = roi;
+	num_bands = std::max(bands, 0);
+	sharpness = sharp;
+	// Every level of the pyramids halves the output exactly
+	int unit = 1 << num_bands;
+	pyr_roi = roi;
+	pyr_roi.width += (unit - roi.width % unit) % unit;
+	pyr_roi.height += (unit - roi.height % unit) % unit;
+	cameras.clear();
+}
+
+cv::Rect StreamStitcher::level_rect(const cv::Rect& rect, int level) const {
+	return cv::Rect((rect.x - pyr_roi.x) >> level, (rect.y - pyr_roi.y) >> level,
+			rect.width >> level, rect.height >> level);
+}
+
+void StreamStitcher::add_camera(
+		const cv::Ptr<cv::detail::RotationWarper>& warper,
+		const cv::Size& source_size, const cv::Mat& K, const cv::Mat& R,
+		const cv::Mat& seam_mask, const cv::Rect& seam_roi, double gain) {
+	Camera camera;
+	camera.source_size = source_size;
+	camera.gain = gain;
+	cv::Mat xmap, ymap;
+	cv::Rect roi = warper->buildMaps(source_size, K, R, xmap, ymap);
+	camera.part = roi & dst_roi;
+	if (camera.part.area() <= 0) {
+		cameras.push_back(camera);
+		return;
+	}
+	cv::Rect local = camera.part - roi.tl();
+	cv::convertMaps(xmap(local), ymap(local), camera.map1, camera.map2,
+			CV_16SC2);
+
+	// Pixels mapped inside the frame and kept by seams
+	cv::Mat mask(camera.part.size(), CV_8U);
+	for (int y = 0; y < mask.rows; y++) {
+		const float* x_row = xmap.ptr<float>(local.y + y) + local.x;
+		const float* y_row = ymap.ptr<float>(local.y + y) + local.x;
+		uchar* mask_row = mask.ptr<uchar>(y);
+		for (int x = 0; x < mask.cols; x++) {
+			int sx = cvRound(x_row[x]), sy = cvRound(y_row[x]);
+			cv::Point seam(camera.part.x + x - seam_roi.x,
+					camera.part.y + y - seam_roi.y);
+			bool inside = sx >= 0 && sy >= 0 && sx < source_size.width
+					&& sy < source_size.height;
+			bool kept = seam.x >= 0 && seam.y >= 0 && seam.x < seam_mask.cols
+					&& seam.y < seam_mask.rows
+					&& seam_mask.at<uchar>(seam.y, seam.x) != 0;
+			mask_row[x] = inside && kept ? 255 : 0;
+		}
+	}
+
+	// Grow and align the part like cv::detail::MultiBandBlender::feed
+	int unit = 1 << num_bands, gap = 3 * unit;
+	cv::Point tl(std::max(camera.part.x - gap, pyr_roi.x),
+			std::max(camera.part.y - gap, pyr_roi.y));
+	cv::Point br(std::min(camera.part.br().x + gap, pyr_roi.br().x),
+			std::min(camera.part.br().y + gap, pyr_roi.br().y));
+	tl.x = pyr_roi.x + (((tl.x - pyr_roi.x) >> num_bands) << num_bands);
+	tl.y = pyr_roi.y + (((tl.y - pyr_roi.y) >> num_bands) << num_bands);
+	int width = br.x - tl.x, height = br.y - tl.y;
+	width += (unit - width % unit) % unit;
+	height += (unit - height % unit) % unit;
+	br = tl + cv::Point(width, height);
+	int dx = std::max(br.x - pyr_roi.br().x, 0);
+	int dy = std::max(br.y - pyr_roi.br().y, 0);
+	camera.rect = cv::Rect(tl.x - dx, tl.y - dy, width, height);
+
+	cv::Mat rect_mask = cv::Mat::zeros(camera.rect.size(), CV_8U);
+	mask.copyTo(rect_mask(camera.part - camera.rect.tl()));
+	camera.weights.resize(num_bands + 1);
+	if (num_bands == 0 && sharpness > 0) {
+		cv::detail::createWeightMap(rect_mask, sharpness, camera.weights[0]);
+	} else {
+		rect_mask.convertTo(camera.weights[0], CV_32F, 1. / 255);
+	}
+	for (int l = 1; l <= num_bands; l++) {
+		cv::pyrDown(camera.weights[l - 1], camera.weights[l]);
+	}
+	cameras.push_back(camera);
+}
+
+void StreamStitcher::start() {
+	// Weights of all cameras sum to 1 at every level, as blending would make them
+	std::vector<cv::Mat> sums(num_bands + 1);
+	for (int l = 0; l <= num_bands; l++) {
+		sums[l] = cv::Mat::zeros(pyr_roi.height >> l, pyr_roi.width >> l,
+				CV_32F);
+		for (size_t i = 0; i < cameras.size(); i++) {
+			if (!cameras[i].weights.empty()) {
+				cv::Mat sum = sums[l](level_rect(cameras[i].rect, l));
+				cv::add(sum, cameras[i].weights[l], sum);
+			}
+		}
+	}
+#pragma omp parallel for
+	for (int i = 0; i < num_cameras(); i++) {
+		Camera& camera = cameras[i];
+		for (size_t l = 0; l < camera.weights.size(); l++) {
+			cv::Mat sum = sums[l](level_rect(camera.rect, l)) + weight_eps;
+			cv::Mat weight;
+			cv::divide(camera.weights[l], sum, weight);
+			std::vector<cv::Mat> channels(3, weight);
+			cv::merge(channels, camera.weights[l]);
+		}
+	}
+	result_mask = sums[0](cv::Rect(cv::Point(0, 0), dst_roi.size()))
+			> weight_eps;
+
+	stages.push_back(std::thread(&StreamStitcher::decode_stage, this));
+	stages.push_back(std::thread(&StreamStitcher::composite_stage, this));
+	stages.push_back(std::thread(&StreamStitcher::encode_stage, this));
+}
+
+cv::Mat StreamStitcher::composite(const std::vector<cv::Mat>& images) {
+	std::vector<cv::Mat> pyr(num_bands + 1);
+	for (int l = 0; l <= num_bands; l++) {
+		pool.attach(pyr[l]).create(pyr_roi.height >> l, pyr_roi.width >> l,
+				CV_32FC3);
+		pyr[l].setTo(cv::Scalar::all(0));
+	}
+	int n = std::min(images.size(), cameras.size());
+#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		const Camera& camera = cameras[i];
+		if (camera.part.area() <= 0 || images[i].empty()) {
+			continue;
+		}
+		cv::Mat src = images[i];
+		if (src.size() != camera.source_size) {
+			cv::resize(images[i], pool.attach(src), camera.source_size);
+		}
+		cv::Mat warped, padded, level;
+		cv::remap(src, pool.attach(warped), camera.map1, camera.map2,
+				cv::INTER_LINEAR, cv::BORDER_REFLECT);
+		src.release();
+		cv::Rect border = camera.part - camera.rect.tl();
+		cv::copyMakeBorder(warped, pool.attach(padded), border.y,
+				camera.rect.height - border.br().y, border.x,
+				camera.rect.width - border.br().x, cv::BORDER_REFLECT);
+		warped.release();
+		padded.convertTo(pool.attach(level), CV_32F, camera.gain);
+		padded.release();
+		// Weighted Laplacian pyramid of the frame
+		std::vector<cv::Mat> laplace(num_bands + 1);
+		for (int l = 0; l < num_bands; l++) {
+			cv::Mat down, up;
+			cv::pyrDown(level, pool.attach(down));
+			cv::pyrUp(down, pool.attach(up), level.size());
+			cv::subtract(level, up, level);
+			cv::multiply(level, camera.weights[l], level);
+			laplace[l] = level;
+			level = down;
+		}
+		cv::multiply(level, camera.weights[num_bands], level);
+		laplace[num_bands] = level;
+#pragma omp critical
+		for (int l = 0; l <= num_bands; l++) {
+			cv::Mat dst = pyr[l](level_rect(camera.rect, l));
+			cv::add(dst, laplace[l], dst);
+		}
+	}
+	for (int l = num_bands; l > 0; l--) {
+		cv::Mat up;
+		cv::pyrUp(pyr[l], pool.attach(up), pyr[l - 1].size());
+		cv::add(pyr[l - 1], up, pyr[l - 1]);
+	}
+	cv::Mat pano;
+	pyr[0](cv::Rect(cv::Point(0, 0), dst_roi.size())).convertTo(pano, CV_8U);
+	pano.setTo(cv::Scalar::all(0), result_mask == 0);
+	composited++;
+	return pano;
+}
+
+void StreamStitcher::decode_stage() {
+	Frame frame;
+	while (inputs.pop(frame)) {
+		frame.images.assign(frame.paths.size(), cv::Mat());
+#pragma omp parallel for
+		for (int i = 0; i < static_cast<int>(frame.paths.size()); i++) {
+			frame.images[i] = cv::imread(frame.paths[i]);
+		}
+		decoded.push(frame);
+	}
+	decoded.close();
+}
+
+void StreamStitcher::composite_stage() {
+	Frame frame;
+	while (decoded.pop(frame)) {
+		frame.pano = composite(frame.images);
+		frame.images.clear();
+		composed.push(frame);
+	}
+	composed.close();
+}
+
+void StreamStitcher::encode_stage() {
+	Frame frame;
+	while (composed.pop(frame)) {
+		if (frame.output.empty()) {
+			outputs.push(frame);
+		} else if (!write_jpeg(frame.output, frame.pano)) {
+			cv::imwrite(frame.output, frame.pano);
+		}
+	}
+	outputs.close();
+}
+
+bool StreamStitcher::push(const std::vector<std::string>& paths,
+		const std::string& output) {
+	Frame frame;
+	frame.paths = paths;
+	frame.output = output;
+	return inputs.push(frame);
+}
+
+bool StreamStitcher::pop(cv::Mat& pano) {
+	Frame frame;
+	if (!outputs.pop(frame)) {
+		return false;
+	}
+	pano = frame.pano;
+	return true;
+}
+
+void StreamStitcher::close() {
+	inputs.close();
+	if (stages.empty()) {
+		outputs.close();
+	}
+	for (size_t i = 0; i < stages.size(); i++) {
+		stages[i].join();
+	}
+	stages.clear();
+}
+
+int StreamStitcher::num_cameras() const {
+	return static_cast<int>(cameras.size());
+}
+
+long StreamStitcher::frames() const {
+	return composited;
+}
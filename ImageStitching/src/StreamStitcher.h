@@ -0,0 +1,160 @@
+/*
+ * StreamStitcher.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_STREAMSTITCHER_H_
+#define SRC_STREAMSTITCHER_H_
+
+#include <bits/stdc++.h>
+#include <omp.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/stitching/detail/blenders.hpp>
+#include <opencv2/stitching/detail/warpers.hpp>
+
+#include "JpegWriter.h"
+#include "MatPool.h"
+
+/*
+ * Blocking queue between two stages of a pipeline, holding at most capacity
+ * items (0 for no bound). Once closed, push fails and pop drains what is left.
+ */
+template<typename T>
+class StageQueue {
+public:
+	StageQueue(size_t bound = 0) :
+			capacity(bound), closed(false) {
+	}
+
+	bool push(const T& item) {
+		std::unique_lock<std::mutex> guard(lock);
+		not_full.wait(guard, [this] {
+			return closed || capacity == 0 || items.size() < capacity;
+		});
+		if (closed) {
+			return false;
+		}
+		items.push_back(item);
+		not_empty.notify_one();
+		return true;
+	}
+
+	bool pop(T& item) {
+		std::unique_lock<std::mutex> guard(lock);
+		not_empty.wait(guard, [this] {
+			return closed || !items.empty();
+		});
+		if (items.empty()) {
+			return false;
+		}
+		item = items.front();
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> guard(lock);
+		closed = true;
+		not_empty.notify_all();
+		not_full.notify_all();
+	}
+
+private:
+	size_t capacity;
+	bool closed;
+	std::deque<T> items;
+	std::mutex lock;
+	std::condition_variable not_empty, not_full;
+};
+
+/*
+ * Stitching of frame sets from a fixed rig calibrated once. Warp maps, masks
+ * cut by seams, gains and normalised blend weights of every level of the
+ * pyramids are computed when cameras are added, so a frame set only costs
+ * decoding, remapping, one Laplacian pyramid per frame and encoding.
+ * Decoding, compositing and encoding run as a pipeline of 3 threads: while a
+ * panorama is encoded the next one is composited and the one after decoded.
+ */
+class StreamStitcher {
+public:
+	//depth: frame sets waiting between two stages
+	StreamStitcher(size_t = 2);
+	virtual ~StreamStitcher();
+
+	/*
+	 * Output region of the canvas and blending, call first
+	 * num_bands: levels of pyramids, 0 to blend by weights at full resolution
+	 * sharpness: feather weights without bands, 0 to copy masked pixels
+	 */
+	void prepare(const cv::Rect&, int, float);
+	/*
+	 * Calibrate the next camera of the rig
+	 * warper, decoded size of its frames, K and R seeing decoded pixels
+	 * seam_mask: CV_8U mask left by seams over seam_roi of the canvas
+	 * gain: exposure gain of the camera
+	 */
+	void add_camera(const cv::Ptr<cv::detail::RotationWarper>&,
+			const cv::Size&, const cv::Mat&, const cv::Mat&, const cv::Mat&,
+			const cv::Rect&, double);
+	//Normalise blend weights of all cameras and start the pipeline
+	void start();
+
+	/*
+	 * Queue a frame set, one image per camera in calibration order. A panorama
+	 * is written to output as JPEG, or kept for pop if output is empty.
+	 * Blocks while the pipeline is full, false once closed
+	 */
+	bool push(const std::vector<std::string>&, const std::string& = "");
+	//Next panorama kept in push order, false once closed and drained
+	bool pop(cv::Mat&);
+	//Stop taking frame sets and wait for the queued ones
+	void close();
+
+	//Composite decoded frames of one set, in calibration order
+	cv::Mat composite(const std::vector<cv::Mat>&);
+
+	int num_cameras() const;
+	//Frame sets composited so far
+	long frames() const;
+
+private:
+	struct Camera {
+		cv::Size source_size; //frames of other sizes are resized to it
+		cv::Rect part; //canvas pixels warped from the frame
+		cv::Rect rect; //part grown and aligned for pyramids
+		cv::Mat map1, map2; //fixed point maps of part
+		double gain;
+		std::vector<cv::Mat> weights; //CV_32FC3 of rect per level, normalised
+	};
+	struct Frame {
+		std::vector<std::string> paths;
+		std::vector<cv::Mat> images;
+		std::string output;
+		cv::Mat pano;
+	};
+
+	//Rect of a level of pyramids, relative to the canvas
+	cv::Rect level_rect(const cv::Rect&, int) const;
+	void decode_stage();
+	void composite_stage();
+	void encode_stage();
+
+	MatPool pool; //buffers of one frame set, reused by the next
+	cv::Rect dst_roi; //output
+	cv::Rect pyr_roi; //output grown to a multiple of the coarsest level
+	int num_bands;
+	float sharpness;
+	std::vector<Camera> cameras;
+	cv::Mat result_mask; //CV_8U of dst_roi, covered pixels
+	std::atomic<long> composited;
+	StageQueue<Frame> inputs, decoded, composed, outputs;
+	std::vector<std::thread> stages;
+};
+
+#endif /* SRC_STREAMSTITCHER_H_ */
@@ -0,0 +1,152 @@
+/*
+ * WarpKernels.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: nvkhoi
+ */
+
+#ifndef SRC_WARPKERNELS_H_
+#define SRC_WARPKERNELS_H_
+
+#include <bits/stdc++.h>
+
+#include <opencv2/core/core.hpp>
+
+#include "PixelKernels.h"
+
+/*
+ * Inverse mappings of OpenCV's rotation warpers, split into a term of the
+ * canvas column and a term of the canvas row. The ray of canvas pixel (u, v),
+ * both divided by scale, is (a * s, y, c * s) with column(u) -> a, c and
+ * row(v) -> s, y. front_only: rays behind the camera are outside the image.
+ */
+struct PlaneProjection {
+	static const bool front_only = false;
+	static void column(float u, float& a, float& c) {
+		a = u;
+		c = 1;
+	}
+	static void row(float v, float& s, float& y) {
+		s = 1;
+		y = v;
+	}
+};
+
+struct CylindricalProjection {
+	static const bool front_only = true;
+	static void column(float u, float& a, float& c) {
+		a = sinf(u);
+		c = cosf(u);
+	}
+	static void row(float v, float& s, float& y) {
+		s = 1;
+		y = v;
+	}
+};
+
+struct SphericalProjection {
+	static const bool front_only = true;
+	static void column(float u, float& a, float& c) {
+		a = sinf(u);
+		c = cosf(u);
+	}
+	static void row(float v, float& s, float& y) {
+		s = sinf(static_cast<float>(CV_PI) - v);
+		y = cosf(static_cast<float>(CV_PI) - v);
+	}
+};
+
+struct MercatorProjection {
+	static const bool front_only = true;
+	static void column(float u, float& a, float& c) {
+		a = sinf(u);
+		c = cosf(u);
+	}
+	static void row(float v, float& s, float& y) {
+		float latitude = atanf(sinhf(v));
+		s = cosf(latitude);
+		y = sinf(latitude);
+	}
+};
+
+/*
+ * Warp the part of a CV_8UC3 image falling into a region of the canvas,
+ * computing the projection's inverse mapping row by row and sampling in the
+ * same pass instead of building map matrices and remapping. Only the mapping
+ * is a simd loop, bilinear sampling gathers pixels one at a time.
+ * K, R: CV_32F camera, scale: scale of the warper
+ * roi: warpRoi of the image
+ * dst, dst_mask: warped pixels (bilinear) and their valid mask (nearest)
+ * Return the part of the canvas covered by dst, empty if image is outside region
+ */
+template<class Projection>
+cv::Rect warp_projected(const cv::Mat& src, const cv::Mat& K, const cv::Mat& R,
+		float scale, const cv::Rect& roi, const cv::Rect& region, cv::Mat& dst,
+		cv::Mat& dst_mask) {
+	cv::Rect part = roi & region;
+	if (part.area() <= 0) {
+		return cv::Rect(0, 0, 0, 0);
+	}
+	CV_Assert(src.type() == CV_8UC3);
+	cv::Mat_<float> k_rinv = cv::Mat(K * R.t());
+	dst.create(part.size(), CV_8UC3);
+	dst_mask.create(part.size(), CV_8U);
+
+	// Terms of the canvas columns, mapped by K * R^-1
+	std::vector<float> col_x(part.width), col_y(part.width), col_z(part.width);
+	for (int x = 0; x < part.width; x++) {
+		float a, c;
+		Projection::column((part.x + x) / scale, a, c);
+		col_x[x] = k_rinv(0, 0) * a + k_rinv(0, 2) * c;
+		col_y[x] = k_rinv(1, 0) * a + k_rinv(1, 2) * c;
+		col_z[x] = k_rinv(2, 0) * a + k_rinv(2, 2) * c;
+	}
+	std::vector<float> map_x(part.width), map_y(part.width);
+	const PixelKernels& kernels = pixel_kernels();
+	const int max_x = src.cols - 1, max_y = src.rows - 1;
+	for (int y = 0; y < part.height; y++) {
+		float s, v;
+		Projection::row((part.y + y) / scale, s, v);
+		float row_x = k_rinv(0, 1) * v, row_y = k_rinv(1, 1) * v, row_z =
+				k_rinv(2, 1) * v;
+		const float* cx = &col_x[0];
+		const float* cy = &col_y[0];
+		const float* cz = &col_z[0];
+		float* mx = &map_x[0];
+		float* my = &map_y[0];
+#pragma omp simd
+		for (int x = 0; x < part.width; x++) {
+			float z = s * cz[x] + row_z;
+			bool front = Projection::front_only ? z > 0 : z != 0;
+			float w = front ? 1.f / z : 0.f;
+			mx[x] = front ? (s * cx[x] + row_x) * w : -1.f;
+			my[x] = front ? (s * cy[x] + row_y) * w : -1.f;
+		}
+
+		uchar* dst_row = dst.ptr<uchar>(y);
+		kernels.map_mask(mx, my, dst_mask.ptr<uchar>(y), part.width, src.cols,
+				src.rows);
+		// Scalar: gathers of 3-byte pixels at arbitrary positions
+		for (int x = 0; x < part.width; x++) {
+			// Replicated border equals reflected border for the pixel bilinear reaches
+			float fx = std::min(std::max(mx[x], 0.f), float(max_x));
+			float fy = std::min(std::max(my[x], 0.f), float(max_y));
+			int x0 = int(fx), y0 = int(fy);
+			int x1 = std::min(x0 + 1, max_x), y1 = std::min(y0 + 1, max_y);
+			float ax = fx - x0, ay = fy - y0;
+			const uchar* p00 = src.ptr<uchar>(y0) + x0 * 3;
+			const uchar* p01 = src.ptr<uchar>(y0) + x1 * 3;
+			const uchar* p10 = src.ptr<uchar>(y1) + x0 * 3;
+			const uchar* p11 = src.ptr<uchar>(y1) + x1 * 3;
+			for (int c = 0; c < 3; c++) {
+				float top = p00[c] + ax * (p01[c] - p00[c]);
+				float bottom = p10[c] + ax * (p11[c] - p10[c]);
+				dst_row[x * 3 + c] = cv::saturate_cast<uchar>(
+						top + ay * (bottom - top));
+			}
+		}
+	}
+	return part;
+}
+
+#endif /* SRC_WARPKERNELS_H_ */
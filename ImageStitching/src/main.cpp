@@ -6,58 +6,223 @@
  */
 
 #include <cstdio>
+#include <csignal>
 #include "Stitcher.h"
+#include "StreamStitcher.h"
 
 std::string uploadDir = "./uploads/", publicDir = "./public/";
 std::string workingDir;
+std::string costModelPath = "cost_model.txt";
+std::string metricsPath = "metrics.prom";
+
+//Token of the running job, cancelled by SIGTERM or SIGINT
+CancelToken jobToken;
+volatile sig_atomic_t terminating = 0;
+
+void cancel_job(int) {
+	terminating = 1;
+	jobToken.cancel();
+}
 
 int main(int argc, char* argv[]) {
-#if ON_LOGGER
-	FILE *f_out = freopen("detail.txt", "a", stdout);
-	if (f_out == NULL)
-		freopen("/dev/tty", "a", stdout);
-#endif
-	cv::setBreakOnError(true);
-	cv::setUseOptimized(true);
 	if (argc < 2)
 		return -1;
+	//Check every pixel kernel variant of this CPU against the scalar reference
+	if (strcmp(argv[1], "--self-test") == 0) {
+		return self_test_kernels() == 0 ? 0 : 1;
+	}
+	//Print the status a job publishes: --read-status file
+	if (strcmp(argv[1], "--read-status") == 0) {
+		if (argc < 3)
+			return -1;
+		const StatusRecord* record = map_status(argv[2]);
+		StatusSnapshot snapshot;
+		bool read = read_status(record, snapshot);
+		unmap_status(record);
+		if (!read)
+			return 1;
+		printf("%s %d/%d %.2lf%% attempt %d return %d ratio %lf\n",
+				snapshot.stage_name.c_str(), snapshot.items_done,
+				snapshot.items_total, snapshot.percent, snapshot.attempt,
+				snapshot.return_code, snapshot.ratio);
+		return 0;
+	}
+	//Written by a background thread, stdout if detail.txt can not be opened
+	start_logger("detail.txt");
+	cv::setBreakOnError(true);
+	cv::setUseOptimized(true);
+	//Band worker: --band-worker session begin end output threads
+	if (strcmp(argv[1], "--band-worker") == 0) {
+		if (argc < 7)
+			return -1;
+		omp_set_num_threads(std::max(1, atoi(argv[6])));
+		Stitcher stitcher;
+		bool rendered = stitcher.load_session(argv[2])
+				&& stitcher.render_band(argv[5], atoi(argv[3]), atoi(argv[4]));
+		return rendered ? 0 : 1;
+	}
+	CostModel cost_model;
+	cost_model.load(costModelPath);
+	Metrics metrics;
+	//Options before input directories: --tier premium|standard|free, --budget seconds, --metrics file, --huge-pages on|off, --crop on|off, --session on|off, --extend on|off, --prescreen on|off, --predict on|off, --hierarchical on|off, --task-graph on|off, --rotation-averaging on|off, --wrap-around on|off, --all-components on|off, --overlap-blend on|off, --bands workers, --deadline seconds, --perf on|off, --stream on|off, --status on|off, --log-level quiet|info|detail
+	bool use_tier = false;
+	CostModel::Tier tier = CostModel::STANDARD;
+	double budget = 0;
+	int band_workers = 0;
+	double deadline = 0;
+	bool huge_pages = false, crop = false, save_session = false, extend = false, prescreen = false,
+			predict = false, hierarchical = false, task_graph = false,
+			rotation_averaging = false, wrap_around = false,
+			all_components = false, overlap_blend = false, perf = false,
+			stream = false, publish_status = false;
+	int first = 1;
+	while (first + 1 < argc && strncmp(argv[first], "--", 2) == 0) {
+		std::string option = argv[first], value = argv[first + 1];
+		if (option == "--tier") {
+			use_tier = true;
+			if (value == "premium") {
+				tier = CostModel::PREMIUM;
+			} else if (value == "free") {
+				tier = CostModel::FREE;
+			} else {
+				tier = CostModel::STANDARD;
+			}
+		} else if (option == "--budget") {
+			use_tier = true;
+			budget = atof(value.c_str());
+		} else if (option == "--metrics") {
+			metricsPath = value;
+		} else if (option == "--huge-pages") {
+			huge_pages = value == "on";
+		} else if (option == "--crop") {
+			crop = value == "on";
+		} else if (option == "--session") {
+			save_session = value == "on";
+		} else if (option == "--prescreen") {
+			prescreen = value == "on";
+		} else if (option == "--predict") {
+			predict = value == "on";
+		} else if (option == "--hierarchical") {
+			hierarchical = value == "on";
+		} else if (option == "--task-graph") {
+			task_graph = value == "on";
+		} else if (option == "--rotation-averaging") {
+			rotation_averaging = value == "on";
+		} else if (option == "--wrap-around") {
+			//Cylindrical and spherical panoramas covering 360 degrees close into a loop
+			wrap_around = value == "on";
+		} else if (option == "--all-components") {
+			//Separate scenes of one upload come back as separate panoramas
+			all_components = value == "on";
+		} else if (option == "--overlap-blend") {
+			overlap_blend = value == "on";
+		} else if (option == "--stream") {
+			//The 1st directory calibrates a fixed rig, the next ones are its frame sets
+			stream = value == "on";
+			save_session = save_session || stream;
+		} else if (option == "--status") {
+			//Publish progress next to the output as <output>.status
+			publish_status = value == "on";
+		} else if (option == "--log-level") {
+			//Detail adds a line per image, pair and predicted stage
+			int level = log_level_of(value);
+			set_log_level(level < 0 ? LOG_LEVEL_INFO : level);
+		} else if (option == "--perf") {
+			perf = value == "on";
+		} else if (option == "--deadline") {
+			deadline = atof(value.c_str());
+		} else if (option == "--bands") {
+			band_workers = atoi(value.c_str());
+		} else if (option == "--extend") {
+			//Add new images of the directory to its saved panorama
+			extend = value == "on";
+			save_session = save_session || extend;
+		}
+		first += 2;
+	}
+	metrics.load(metricsPath);
+	signal(SIGTERM, cancel_job);
+	signal(SIGINT, cancel_job);
 	long long start;
-	for (int i = 1; i < argc; i++) {
-#if ON_LOGGER
-		printf("%s\n", argv[i]);
-#endif
+	int last = stream ? std::min(argc, first + 1) : argc;
+	for (int i = first; i < last && !terminating; i++) {
+		LOG_INFO("%s\n", argv[i]);
 		workingDir = argv[i];
 		Stitcher stitcher;
+		stitcher.set_cost_model(&cost_model);
+		stitcher.set_metrics(&metrics);
+		stitcher.set_huge_pages(huge_pages);
+		stitcher.set_crop(crop);
+		stitcher.set_prescreen(prescreen);
+		stitcher.set_prediction(predict);
+		stitcher.set_hierarchical(hierarchical);
+		stitcher.set_task_graph(task_graph);
+		stitcher.set_rotation_averaging(rotation_averaging);
+		stitcher.set_wrap_around(wrap_around);
+		stitcher.set_all_components(all_components);
+		stitcher.set_overlap_blend(overlap_blend);
+		stitcher.set_band_workers(band_workers);
+		stitcher.set_perf_counters(perf);
+		//The deadline counts from reading inputs
+		jobToken.restart(deadline);
+		if (terminating)
+			break;
+		stitcher.set_cancel_token(&jobToken);
+		if (use_tier) {
+			stitcher.set_quality_tier(tier, budget);
+		}
 		std::string dst = publicDir + workingDir;
-#if ON_LOGGER
 		start = cv::getTickCount();
-#endif
 		stitcher.set_dst(dst);
-#if ON_LOGGER
-		printf("%lf\n",
+		if (publish_status) {
+			stitcher.set_status_file(dst + ".status");
+		}
+		if (save_session) {
+			stitcher.set_session(dst + ".yml.gz");
+		}
+		LOG_INFO("%lf\n",
 				(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
 
 		workingDir = uploadDir + workingDir + "/";
 
-#if ON_LOGGER
 		start = cv::getTickCount();
-#endif
-		stitcher.feed(workingDir);
-#if ON_LOGGER
-		printf("%lf\n",
+		bool extended = extend && stitcher.load_session(dst + ".yml.gz")
+				&& stitcher.extend(workingDir);
+		if (!extended) {
+			stitcher.feed(workingDir);
+		}
+		LOG_INFO("%lf\n",
 				(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
 
-#if ON_LOGGER
 		start = cv::getTickCount();
-#endif
-		stitcher.stitch();
-#if ON_LOGGER
-		printf("%s\n", stitcher.get_status().c_str());
-		printf("%lf\n",
+		if (!extended) {
+			stitcher.stitch();
+		}
+		LOG_INFO("%s\n", stitcher.get_status().c_str());
+		LOG_INFO("%lf\n",
 				(double(cv::getTickCount()) - start) / cv::getTickFrequency());
-#endif
+		cost_model.save(costModelPath);
+		metrics.save(metricsPath);
+	}
+	if (stream && first + 1 < argc && !terminating) {
+		Stitcher calibration;
+		StreamStitcher frames;
+		if (!calibration.load_session(publicDir + argv[first] + ".yml.gz")
+				|| !calibration.prepare_stream(frames))
+			return 1;
+		frames.start();
+		start = cv::getTickCount();
+		for (int i = first + 1; i < argc && !terminating; i++) {
+			std::vector<std::string> paths;
+			if (calibration.stream_paths(uploadDir + argv[i] + "/", paths)) {
+				frames.push(paths, publicDir + argv[i] + ".jpg");
+			}
+		}
+		frames.close();
+		double elapsed = (double(cv::getTickCount()) - start)
+				/ cv::getTickFrequency();
+		LOG_INFO("%ld frame sets, %lf fps\n", frames.frames(),
+				frames.frames() / elapsed);
 	}
 
 	return 0;
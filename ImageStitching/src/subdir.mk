@@ -1,20 +1,92 @@
-CXXFLAGS=-std=c++11 -O3 -Wall -fopenmp -ffast-math
+CXXFLAGS=-std=c++11 -O3 -Wall -fopenmp -pthread -ffast-math
 
 # Inputs and outputs 
 CPP_SRCS += \
+./src/Bands.cpp \
+./src/Canvas.cpp \
+./src/CanvasLoop.cpp \
+./src/CostModel.cpp \
+./src/FastFeatherBlender.cpp \
+./src/JpegWriter.cpp \
+./src/Logger.cpp \
+./src/MatPool.cpp \
+./src/Metrics.cpp \
+./src/OverlapBlender.cpp \
+./src/PerfCounters.cpp \
+./src/PixelKernels.cpp \
+./src/Predictor.cpp \
+./src/Prescreen.cpp \
+./src/RotationAveraging.cpp \
+./src/Session.cpp \
+./src/StatusChannel.cpp \
 ./src/Stitcher.cpp \
+./src/StreamStitcher.cpp \
 ./src/main.cpp 
 
 O_SRCS += \
+./src/Bands.o \
+./src/Canvas.o \
+./src/CanvasLoop.o \
+./src/CostModel.o \
+./src/FastFeatherBlender.o \
+./src/JpegWriter.o \
+./src/Logger.o \
+./src/MatPool.o \
+./src/Metrics.o \
+./src/OverlapBlender.o \
+./src/PerfCounters.o \
+./src/PixelKernels.o \
+./src/Predictor.o \
+./src/Prescreen.o \
+./src/RotationAveraging.o \
+./src/Session.o \
+./src/StatusChannel.o \
 ./src/Stitcher.o \
+./src/StreamStitcher.o \
 ./src/main.o 
 
 OBJS += \
+./src/Bands.o \
+./src/Canvas.o \
+./src/CanvasLoop.o \
+./src/CostModel.o \
+./src/FastFeatherBlender.o \
+./src/JpegWriter.o \
+./src/Logger.o \
+./src/MatPool.o \
+./src/Metrics.o \
+./src/OverlapBlender.o \
+./src/PerfCounters.o \
+./src/PixelKernels.o \
+./src/Predictor.o \
+./src/Prescreen.o \
+./src/RotationAveraging.o \
+./src/Session.o \
+./src/StatusChannel.o \
 ./src/Stitcher.o \
+./src/StreamStitcher.o \
 ./src/main.o 
 
 CPP_DEPS += \
+./src/Bands.d \
+./src/Canvas.d \
+./src/CanvasLoop.d \
+./src/CostModel.d \
+./src/FastFeatherBlender.d \
+./src/JpegWriter.d \
+./src/Logger.d \
+./src/MatPool.d \
+./src/Metrics.d \
+./src/OverlapBlender.d \
+./src/PerfCounters.d \
+./src/PixelKernels.d \
+./src/Predictor.d \
+./src/Prescreen.d \
+./src/RotationAveraging.d \
+./src/Session.d \
+./src/StatusChannel.d \
 ./src/Stitcher.d \
+./src/StreamStitcher.d \
 ./src/main.d 
 
 